@@ -1,5 +1,20 @@
 #pragma once
 #include "BMP.h"
+#include "SimdKernels.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 Bmp::Bmp(int32_t width, int32_t height, bool has_alpha) {
 	if (width <= 0 || height <= 0) {
@@ -99,6 +114,7 @@ void Bmp::read(const char* fname) {
 }
 
 void Bmp::write(const char* fname) {
+	TRACE_SCOPE("Bmp::write");
 	std::ofstream of{ fname, std::ios_base::binary };
 	if (of) {
 		if (bmp_info_header.bit_count == 32) {
@@ -163,125 +179,247 @@ void Bmp::check_color_header(BmpColorHeader& bmp_color_header) {
 	}
 }
 
-RgbImage::RgbImage(Bmp* bmpImage)
-{
-	this->width_ = bmpImage->bmp_info_header.width;
-	this->height_ = bmpImage->bmp_info_header.height;
-	data = new RgbPixel * [this->width_];
-	data[0] = new RgbPixel[this->width_ * this->height_];
-	uint32_t channels = bmpImage->bmp_info_header.bit_count / 8;
-	for (uint32_t y = 0; y < this->height_; ++y) {
-		for (uint32_t x = 0; x < this->width_; ++x) {
-			data[0][y * this->width_ + x].b = bmpImage->data[channels * (y * this->width_ + x) + 0];
-			data[0][y * this->width_ + x].g = bmpImage->data[channels * (y * this->width_ + x) + 1];
-			data[0][y * this->width_ + x].r = bmpImage->data[channels * (y * this->width_ + x) + 2];
+MappedBmp::MappedBmp(const char* fname) {
+	TRACE_SCOPE("MappedBmp");
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Unable to open the input image file.");
+	}
+	handle_ = file;
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	size_ = (size_t)fileSize.QuadPart;
+	if (size_ > 0) {
+		mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping_ != nullptr)
+			file_ = (const uint8_t*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+	}
+#else
+	descriptor_ = open(fname, O_RDONLY);
+	if (descriptor_ < 0) {
+		throw std::runtime_error("Unable to open the input image file.");
+	}
+	struct stat info;
+	if (fstat(descriptor_, &info) == 0 && info.st_size > 0) {
+		size_ = (size_t)info.st_size;
+		void* memory = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, descriptor_, 0);
+		if (memory != MAP_FAILED) {
+			file_ = (const uint8_t*)memory;
+			madvise(memory, size_, MADV_SEQUENTIAL);
 		}
 	}
-	for (int i = 1; i < this->width_; ++i)
-		data[i] = data[i - 1] + this->height_;
-}
+#endif
+	if (file_ == nullptr) {
+		unmap();
+		throw std::runtime_error("Unable to map the input image file.");
+	}
 
-RgbImage::RgbImage(int width, int height, float value) {
-	this->width_ = width;
-	this->height_ = height;
-	data = new RgbPixel * [width];
-	data[0] = new RgbPixel[width * height];
-	for (int i = 0; i < width * height; ++i)
-	{
-		data[0][i].r = value;
-		data[0][i].g = value;
-		data[0][i].b = value;
+	// the headers are packed and may be unaligned in the mapping, so they are copied out
+	if (size_ < sizeof(BmpFileHeader) + sizeof(BmpInfoHeader)) {
+		unmap();
+		throw std::runtime_error("Error! Unrecognized file format.");
+	}
+	memcpy(&file_header, file_, sizeof(file_header));
+	memcpy(&bmp_info_header, file_ + sizeof(BmpFileHeader), sizeof(bmp_info_header));
+
+	const char* error = nullptr;
+	if (file_header.file_type != 0x4D42)
+		error = "Error! Unrecognized file format.";
+	else if (bmp_info_header.bit_count != 24 && bmp_info_header.bit_count != 32)
+		error = "The program can treat only 24 or 32 bits per pixel BMP files";
+	else if (bmp_info_header.compression != 0 && bmp_info_header.compression != 3)
+		error = "The program can treat only uncompressed BMP images";
+	else if (bmp_info_header.height < 0)
+		error = "The program can treat only BMP images with the origin in the bottom left corner!";
+	else if (bmp_info_header.width <= 0 || bmp_info_header.height == 0)
+		error = "The image width and height must be positive numbers.";
+
+	if (error == nullptr && bmp_info_header.bit_count == 32) {
+		if (bmp_info_header.size < sizeof(BmpInfoHeader) + sizeof(BmpColorHeader)
+			|| size_ < sizeof(BmpFileHeader) + sizeof(BmpInfoHeader) + sizeof(BmpColorHeader))
+			error = "Error! Unrecognized file format.";
+		else {
+			BmpColorHeader color_header;
+			memcpy(&color_header, file_ + sizeof(BmpFileHeader) + sizeof(BmpInfoHeader), sizeof(color_header));
+			BmpColorHeader expected_color_header;
+			if (expected_color_header.red_mask != color_header.red_mask ||
+				expected_color_header.blue_mask != color_header.blue_mask ||
+				expected_color_header.green_mask != color_header.green_mask ||
+				expected_color_header.alpha_mask != color_header.alpha_mask)
+				error = "Unexpected color mask format! The program expects the pixel data to be in the BGRA format";
+			else if (expected_color_header.color_space_type != color_header.color_space_type)
+				error = "Unexpected color space type! The program expects sRGB values";
+		}
 	}
 
-	for (int i = 1; i < width; ++i)
-		data[i] = data[i - 1] + height;
-}
+	if (error == nullptr) {
+		row_stride_ = ((uint32_t)bmp_info_header.width * bmp_info_header.bit_count / 8 + 3) / 4 * 4;
+		if (file_header.offset_data > size_ || (size_ - file_header.offset_data) / row_stride_ < (size_t)bmp_info_header.height)
+			error = "The pixel data is shorter than the image size.";
+	}
 
-GrayImage::GrayImage(RgbImage* rgbImage) {
-	this->width_ = rgbImage->getWidth();
-	this->height_ = rgbImage->getHeight();
-	data = new int* [this->width_];
-	data[0] = new int[this->width_ * this->height_];
-	for (int i = 0; i < this->width_ * this->height_; ++i)
-	{
-		data[0][i] = (int)round((rgbImage->data[0][i].r + rgbImage->data[0][i].g + rgbImage->data[0][i].b) / 3.0);
+	if (error != nullptr) {
+		unmap();
+		throw std::runtime_error(error);
 	}
-	for (int i = 1; i < this->height_; ++i)
-		data[i] = data[i - 1] + this->width_;
+	pixels_ = file_ + file_header.offset_data;
+}
+
+MappedBmp::~MappedBmp() {
+	unmap();
 }
 
-GrayImage::GrayImage(int width, int height, int value) {
-	this->width_ = width;
-	this->height_ = height;
-	data = new int* [width];
-	data[0] = new int[width * height];
-	for (int i = 0; i < width * height; ++i)
-		data[0][i] = value;
-	for (int i = 1; i < height; ++i)
-		data[i] = data[i - 1] + width;
+void MappedBmp::unmap() {
+#ifdef _WIN32
+	if (file_ != nullptr)
+		UnmapViewOfFile(file_);
+	if (mapping_ != nullptr)
+		CloseHandle(mapping_);
+	if (handle_ != nullptr)
+		CloseHandle(handle_);
+	mapping_ = nullptr;
+	handle_ = nullptr;
+#else
+	if (file_ != nullptr)
+		munmap((void*)file_, size_);
+	if (descriptor_ >= 0)
+		close(descriptor_);
+	descriptor_ = -1;
+#endif
+	file_ = nullptr;
 }
 
-void GrayImage::copy(GrayImage* grayImage) {
-	this->width_ = grayImage->getWidth();
-	this->height_ = grayImage->getHeight();
-	delete[] data[0];
-	delete[] data;
-	data = new int* [this->width_];
-	data[0] = new int[this->width_ * this->height_];
-	for (int i = 0; i < this->width_ * this->height_; ++i)
-	{
-		data[0][i] = grayImage->data[0][i];
+void MappedBmp::toGray(GrayView grayImage, int firstRow) {
+	TRACE_SCOPE("MappedBmp::toGray");
+	int channels = bmp_info_header.bit_count / 8;
+	parallelRows(grayImage.getHeight(), ROW_GRAIN, [&](int bandRow, int endRow) {
+		for (int y = bandRow; y < endRow; ++y)
+			bgrToGrayRow(row(firstRow + y), channels, grayImage.row(y), getWidth());
+	});
+}
+
+void MappedBmp::toRgb(RgbView rgbImage, int firstRow) {
+	TRACE_SCOPE("MappedBmp::toRgb");
+	int channels = bmp_info_header.bit_count / 8;
+	parallelRows(rgbImage.getHeight(), ROW_GRAIN, [&](int bandRow, int endRow) {
+		for (int y = bandRow; y < endRow; ++y) {
+			const uint8_t* src = row(firstRow + y);
+			RgbPixel* dst = rgbImage.row(y);
+			for (int x = 0; x < getWidth(); ++x) {
+				dst[x].b = src[channels * x + 0];
+				dst[x].g = src[channels * x + 1];
+				dst[x].r = src[channels * x + 2];
+			}
+		}
+	});
+}
+
+BmpWriter::BmpWriter(const char* fname, int32_t width, int32_t height) : of_(fname, std::ios_base::binary) {
+	if (width <= 0 || height <= 0) {
+		throw std::runtime_error("The image width and height must be positive numbers.");
 	}
-	for (int i = 1; i < this->height_; ++i)
-		data[i] = data[i - 1] + this->width_;
+	if (!of_) {
+		throw std::runtime_error("Unable to open the output image file.");
+	}
+	width_ = width;
+	height_ = height;
+
+	// rows are padded to 4 bytes like Bmp::write does for 24-bit images
+	uint32_t row_stride = (uint32_t)width * 3;
+	uint32_t padded_stride = (row_stride + 3) / 4 * 4;
+	row_.assign(padded_stride, 0);
+
+	BmpFileHeader file_header;
+	BmpInfoHeader bmp_info_header;
+	bmp_info_header.width = width;
+	bmp_info_header.height = height;
+	bmp_info_header.size = sizeof(BmpInfoHeader);
+	bmp_info_header.bit_count = 24;
+	bmp_info_header.compression = 0;
+	file_header.offset_data = sizeof(BmpFileHeader) + sizeof(BmpInfoHeader);
+	file_header.file_size = file_header.offset_data + padded_stride * (uint32_t)height;
+
+	of_.write((const char*)&file_header, sizeof(file_header));
+	of_.write((const char*)&bmp_info_header, sizeof(bmp_info_header));
 }
 
-void GrayImage::setValues(int value, int width, int height) {
-	if (width == 0 || height == 0)
-	{
-		int size = this->width_ * this->height_;
-		for (int i = 0; i < size; ++i)
-			this->data[0][i] = value;
+void BmpWriter::writeRows(RgbView rows) {
+	TRACE_SCOPE("BmpWriter::writeRows");
+	if (rows.getWidth() != width_ || written_ + rows.getHeight() > height_) {
+		throw std::runtime_error("The rows do not fit the output image.");
 	}
-	else
-	{
-		delete[] data[0];
-		delete[] data;
-		this->width_ = width;
-		this->height_ = height;
-		data = new int* [width];
-		data[0] = new int[width * height];
-		for (int i = 0; i < width * height; ++i)
-			data[0][i] = value;
-		for (int i = 1; i < height; ++i)
-			data[i] = data[i - 1] + width;
+	for (int y = 0; y < rows.getHeight(); ++y) {
+		RgbPixel* src = rows.row(y);
+		for (int x = 0; x < width_; ++x) {
+			row_[3 * x + 0] = src[x].b;
+			row_[3 * x + 1] = src[x].g;
+			row_[3 * x + 2] = src[x].r;
+		}
+		of_.write((const char*)row_.data(), row_.size());
 	}
+	written_ += rows.getHeight();
+}
+
+void bmpToRgb(Bmp* bmpImage, RgbView rgbImage) {
+
+	int width = rgbImage.getWidth();
+	int height = rgbImage.getHeight();
+	uint32_t channels = bmpImage->bmp_info_header.bit_count / 8;
 
+	parallelRows(height, ROW_GRAIN, [&](int firstRow, int endRow) {
+		for (int y = firstRow; y < endRow; ++y) {
+			const uint8_t* src = bmpImage->data.data() + (size_t)channels * y * width;
+			RgbPixel* dst = rgbImage.row(y);
+			for (int x = 0; x < width; ++x) {
+				dst[x].b = src[channels * x + 0];
+				dst[x].g = src[channels * x + 1];
+				dst[x].r = src[channels * x + 2];
+			}
+		}
+	});
+}
+
+void rgbToGray(RgbView rgbImage, GrayView grayImage) {
+
+	parallelRows(rgbImage.getHeight(), ROW_GRAIN, [&](int firstRow, int endRow) {
+		for (int y = firstRow; y < endRow; ++y)
+			bgrToGrayRow((const uint8_t*)rgbImage.row(y), 3, grayImage.row(y), rgbImage.getWidth());
+	});
 }
 
-int grayToRgb(GrayImage* grayImage, RgbImage* rgbImage) {
+int grayToRgb(GrayView grayImage, RgbView rgbImage) {
 
-	if (grayImage->getWidth() != rgbImage->getWidth() || grayImage->getHeight() != rgbImage->getHeight())
+	if (grayImage.getWidth() != rgbImage.getWidth() || grayImage.getHeight() != rgbImage.getHeight())
 		return 1;
-	for (int i = 0; i < grayImage->getWidth() * grayImage->getHeight(); ++i)
-	{
-		rgbImage->data[0][i].r = (float)grayImage->data[0][i];
-		rgbImage->data[0][i].g = (float)grayImage->data[0][i];
-		rgbImage->data[0][i].b = (float)grayImage->data[0][i];
-	}
+	parallelRows(grayImage.getHeight(), ROW_GRAIN, [&](int firstRow, int endRow) {
+		for (int y = firstRow; y < endRow; ++y) {
+			uint8_t* src = grayImage.row(y);
+			RgbPixel* dst = rgbImage.row(y);
+			for (int x = 0; x < grayImage.getWidth(); ++x) {
+				dst[x].r = src[x];
+				dst[x].g = src[x];
+				dst[x].b = src[x];
+			}
+		}
+	});
 	return 0;
 }
 
-void rgbToBmp(RgbImage* rgbImage, Bmp* bmpImage) {
+void rgbToBmp(RgbView rgbImage, Bmp* bmpImage) {
 
-	int width = rgbImage->getWidth();
-	int height = rgbImage->getHeight();
+	int width = rgbImage.getWidth();
+	int height = rgbImage.getHeight();
 
-	for (uint32_t y = 0; y < height; ++y) {
-		for (uint32_t x = 0; x < width; ++x) {
-			bmpImage->data[3 * (y * width + x) + 0] = (uint8_t)rgbImage->data[0][y * width + x].b;
-			bmpImage->data[3 * (y * width + x) + 1] = (uint8_t)rgbImage->data[0][y * width + x].g;
-			bmpImage->data[3 * (y * width + x) + 2] = (uint8_t)rgbImage->data[0][y * width + x].r;
+	parallelRows(height, ROW_GRAIN, [&](int firstRow, int endRow) {
+		for (int y = firstRow; y < endRow; ++y) {
+			RgbPixel* src = rgbImage.row(y);
+			uint8_t* dst = bmpImage->data.data() + (size_t)3 * y * width;
+			for (int x = 0; x < width; ++x) {
+				dst[3 * x + 0] = src[x].b;
+				dst[3 * x + 1] = src[x].g;
+				dst[3 * x + 2] = src[x].r;
+			}
 		}
-	}
-}
\ No newline at end of file
+	});
+}
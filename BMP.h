@@ -4,6 +4,7 @@
 #include <vector>
 #include <stdexcept>
 #include <iostream>
+#include "TypedImage.h"
 
 #pragma pack(push, 1)
 struct BmpFileHeader {
@@ -76,51 +77,88 @@ private:
     void check_color_header(BmpColorHeader& bmp_color_header);
 };
 
+// 24-bit pixel in the byte order used by BMP files
 struct RgbPixel {
-    RgbPixel() { r = 0; g = 0; b = 0; }
-    float r;
-    float g;
-    float b;
+    uint8_t b;
+    uint8_t g;
+    uint8_t r;
 };
 
-struct RgbImage {
+typedef Image<RgbPixel> RgbImage;
+typedef ImageView<RgbPixel> RgbView;
 
-    RgbImage(Bmp* bmpImage);
+typedef Image<uint8_t> GrayImage;
+typedef ImageView<uint8_t> GrayView;
 
-    RgbImage(int width, int height, float value = 0.0);
+typedef Image<int32_t> LabelImage;
+typedef ImageView<int32_t> LabelView;
 
-    ~RgbImage() { delete[] data[0]; delete[] data; }
+// Read-only memory mapping of a 24 or 32 bits per pixel BMP file. The headers are validated in place and
+// pixels are decoded straight from the mapped rows, without reading the file into an intermediate buffer.
+struct MappedBmp {
 
-    int getWidth() { return this->width_; }
-    int getHeight() { return this->height_; }
+    MappedBmp(const char* fname);
 
-    RgbPixel** data;
+    ~MappedBmp();
 
-private:
-    int width_;
-    int height_;
-};
+    MappedBmp(const MappedBmp&) = delete;
+    MappedBmp& operator=(const MappedBmp&) = delete;
+
+    int getWidth() { return bmp_info_header.width; }
+    int getHeight() { return bmp_info_header.height; }
+
+    // Row y as stored in the file, bottom-up like the rows of Bmp::data
+    const uint8_t* row(int y) { return pixels_ + (size_t)row_stride_ * y; }
+
+    // Integer average of the three channels, rounded like rgbToGray. The view receives
+    // as many rows as it holds, starting at firstRow.
+    void toGray(GrayView grayImage, int firstRow = 0);
+
+    void toRgb(RgbView rgbImage, int firstRow = 0);
 
-struct GrayImage {
+    BmpFileHeader file_header;
+    BmpInfoHeader bmp_info_header;
 
-    GrayImage(RgbImage* image);
+private:
+    const uint8_t* file_{ nullptr };
+    const uint8_t* pixels_{ nullptr };
+    size_t size_{ 0 };
+    uint32_t row_stride_{ 0 };
+#ifdef _WIN32
+    void* handle_{ nullptr };
+    void* mapping_{ nullptr };
+#else
+    int descriptor_{ -1 };
+#endif
+
+    void unmap();
+};
 
-    GrayImage(int width, int height, int value = 0);
+// Writes a 24 bits per pixel BMP file a band of rows at a time, in the row order of Bmp::data,
+// so a result never has to be held in memory as a whole.
+struct BmpWriter {
 
-    ~GrayImage() { delete[] data[0]; delete[] data; }
+    BmpWriter(const char* fname, int32_t width, int32_t height);
 
-    int getWidth() { return this->width_; }
-    int getHeight() { return this->height_; }
+    // Appends the rows of the view; they must have the width of the bitmap
+    void writeRows(RgbView rows);
 
-    void copy(GrayImage* im);
-    void setValues(int value = 0, int width = PREVIOUS, int height = PREVIOUS);
+    int getWrittenRows() { return written_; }
 
-    int** data;
 private:
-    int width_;
-    int height_;
+    std::ofstream of_;
+    int32_t width_;
+    int32_t height_;
+    int written_{ 0 };
+    std::vector<uint8_t> row_;
 };
 
-int grayToRgb(GrayImage* grayImage, RgbImage* rgbImage);
+// rgbImage must have the size of the bitmap
+void bmpToRgb(Bmp* bmpImage, RgbView rgbImage);
+
+// Average of the three channels, rounded
+void rgbToGray(RgbView rgbImage, GrayView grayImage);
+
+int grayToRgb(GrayView grayImage, RgbView rgbImage);
 
-void rgbToBmp(RgbImage* rgbImage, Bmp* bmpImage);
+void rgbToBmp(RgbView rgbImage, Bmp* bmpImage);
@@ -0,0 +1,237 @@
+#include "BatchPipeline.h"
+#include "BMP.h"
+#include "HoughCircleDetector.h"
+#include "Image.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+// Image travelling through the pipeline; the buffers are owned by whichever stage holds it
+struct BatchItem {
+	int index = -1;
+	std::unique_ptr<MappedBmp> bmpImage;
+	std::unique_ptr<GrayImage> grayImage;
+	std::vector <CentersPoint> circles;
+};
+
+double millisecondsSince(std::chrono::steady_clock::time_point tic) {
+	std::chrono::steady_clock::duration period = std::chrono::steady_clock::now() - tic;
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(period).count() / (1000.0 * 1000.0);
+}
+
+// Message of the exception being handled, for the failures recorded in BatchResult
+std::string currentError() {
+	try {
+		throw;
+	}
+	catch (const std::exception& error) {
+		return error.what();
+	}
+	catch (...) {
+		return "unknown error";
+	}
+}
+
+std::vector <std::string> batchInputs(const char* listOrDirectory) {
+
+	std::vector <std::string> inputs;
+	if (std::filesystem::is_directory(listOrDirectory)) {
+		for (const auto& entry : std::filesystem::directory_iterator(listOrDirectory)) {
+			std::string extension = entry.path().extension().string();
+			std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+			if (entry.is_regular_file() && extension == ".bmp")
+				inputs.push_back(entry.path().string());
+		}
+		std::sort(inputs.begin(), inputs.end());
+		return inputs;
+	}
+
+	std::ifstream list(listOrDirectory);
+	if (!list)
+		throw std::runtime_error("Unable to open the batch list.");
+	std::string line;
+	while (std::getline(list, line)) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (!line.empty())
+			inputs.push_back(line);
+	}
+	return inputs;
+}
+
+std::vector <BatchResult> runBatch(const std::vector <std::string>& inputs, BatchOptions options, double* wallTime) {
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector <BatchResult> results;
+	for (const std::string& input : inputs)
+		results.push_back(BatchResult(input));
+
+	if (!options.outputDirectory.empty())
+		std::filesystem::create_directories(options.outputDirectory);
+
+	// frames of a sequence must reach the one tracking detector in order
+	if (options.sequence) {
+		options.readers = 1;
+		options.detectors = 1;
+	}
+
+	BoundedQueue<BatchItem> decoded(options.queueDepth);
+	BoundedQueue<BatchItem> detected(options.queueDepth);
+
+	// readers take the next input in turn; the last one to finish closes the queue to the detectors
+	std::atomic<size_t> nextInput{ 0 };
+	std::atomic<int> activeReaders{ std::max(options.readers, 1) };
+	std::vector <std::thread> readers;
+	for (int r = 0; r < std::max(options.readers, 1); ++r)
+		readers.push_back(std::thread([&, r] {
+			TRACE_THREAD_NAME("reader " + std::to_string(r));
+			for (size_t n = nextInput++; n < inputs.size(); n = nextInput++) {
+				TRACE_SCOPE("read image");
+				auto tic = std::chrono::steady_clock::now();
+				BatchItem item;
+				item.index = (int)n;
+				try {
+					item.bmpImage.reset(new MappedBmp(inputs[n].c_str()));
+					int width = item.bmpImage->getWidth();
+					int height = item.bmpImage->getHeight();
+					item.grayImage.reset(new GrayImage(width, height));
+					item.bmpImage->toGray(*item.grayImage);
+					results[n].bytes = (size_t)width * height * (item.bmpImage->bmp_info_header.bit_count / 8);
+				}
+				catch (...) {
+					results[n].error = currentError();
+					continue;
+				}
+				results[n].readTime = millisecondsSince(tic);
+				decoded.push(std::move(item));
+			}
+			if (--activeReaders == 0)
+				decoded.close();
+		}));
+
+	std::vector <std::thread> writers;
+	for (int w = 0; w < std::max(options.writers, 1); ++w)
+		writers.push_back(std::thread([&, w] {
+			TRACE_THREAD_NAME("writer " + std::to_string(w));
+			BatchItem item;
+			while (detected.pop(item)) {
+				TRACE_SCOPE("write image");
+				auto tic = std::chrono::steady_clock::now();
+				BatchResult& result = results[item.index];
+				if (!options.outputDirectory.empty()) {
+					try {
+						std::filesystem::path output = std::filesystem::path(options.outputDirectory) / std::filesystem::path(result.input).filename();
+						int width = item.bmpImage->getWidth();
+						int height = item.bmpImage->getHeight();
+						GrayImage marks(width, height);
+						markCircles(marks, item.circles);
+						RgbImage rgbImage(width, height);
+						item.bmpImage->toRgb(rgbImage);
+						drawCircles(rgbImage, marks);
+						BmpWriter writer(output.string().c_str(), width, height);
+						writer.writeRows(rgbImage);
+						result.output = output.string();
+					}
+					catch (...) {
+						result.error = currentError();
+					}
+				}
+				item = BatchItem();
+				result.writeTime = millisecondsSince(tic);
+			}
+		}));
+
+	// every detection thread owns its detector; the last one to finish closes the queue to the writers
+	std::atomic<int> activeDetectors{ std::max(options.detectors, 1) };
+	std::vector <std::thread> detectors;
+	for (int d = 0; d < std::max(options.detectors, 1); ++d)
+		detectors.push_back(std::thread([&, d] {
+			TRACE_THREAD_NAME("detector " + std::to_string(d));
+			HoughCircleDetector detector(options.gradientVoting);
+			detector.tracking = options.sequence;
+			detector.pyramid = options.pyramid;
+			detector.pyramidRevote = options.pyramidRevote;
+			detector.subPixel = options.subPixel;
+			detector.engine = options.engine;
+			detector.radii = options.radii;
+			BatchItem item;
+			while (decoded.pop(item)) {
+				auto tic = std::chrono::steady_clock::now();
+				TrackingStats before = detector.getTrackingStats();
+				BatchResult& result = results[item.index];
+				// a failed image is recorded and dropped, the next one starts without tracked circles
+				try {
+					item.circles = detector.detect(*item.grayImage);
+				}
+				catch (...) {
+					result.error = currentError();
+					detector.resetTracking();
+					continue;
+				}
+				item.grayImage.reset();
+				result.detectTime = millisecondsSince(tic);
+				TrackingStats after = detector.getTrackingStats();
+				result.tracked = after.tracked - before.tracked;
+				result.searched = (after.fresh + after.fallbacks) - (before.fresh + before.fallbacks);
+				result.lost = after.lost - before.lost;
+				detected.push(std::move(item));
+			}
+			if (--activeDetectors == 0)
+				detected.close();
+		}));
+
+	for (std::thread& detector : detectors)
+		detector.join();
+	for (std::thread& reader : readers)
+		reader.join();
+	for (std::thread& writer : writers)
+		writer.join();
+
+	*wallTime = millisecondsSince(start);
+	return results;
+}
+
+void printBatchReport(const std::vector <BatchResult>& results, double wallTime) {
+
+	int processed = 0;
+	size_t bytes = 0;
+	double readTime = 0;
+	double detectTime = 0;
+	double writeTime = 0;
+	int tracked = 0;
+	int searched = 0;
+	int lost = 0;
+
+	std::cout << "image\tread\tdetect\twrite" << std::endl;
+	for (const BatchResult& result : results) {
+		if (!result.error.empty()) {
+			std::cout << result.input << "\tfailed: " << result.error << std::endl;
+			continue;
+		}
+		std::cout << result.input << "\t" << result.readTime << "\t" << result.detectTime << "\t" << result.writeTime << std::endl;
+		++processed;
+		bytes += result.bytes;
+		readTime += result.readTime;
+		detectTime += result.detectTime;
+		writeTime += result.writeTime;
+		tracked += result.tracked;
+		searched += result.searched;
+		lost += result.lost;
+	}
+
+	double seconds = wallTime / 1000.0;
+	std::cout << "images: " << processed << " processed, " << results.size() - processed << " failed" << std::endl;
+	std::cout << "wall time: " << wallTime << " ms, " << (seconds > 0 ? processed / seconds : 0) << " images/s, "
+		<< (seconds > 0 ? bytes / seconds / (1024.0 * 1024.0) : 0) << " MB/s" << std::endl;
+	std::cout << "stage totals: read " << readTime << " ms, detect " << detectTime << " ms, write " << writeTime << " ms" << std::endl;
+	if (tracked + searched > 0)
+		std::cout << "segments: " << tracked << " tracked, " << searched << " searched in full ("
+			<< 100.0 * tracked / (tracked + searched) << "% tracked), " << lost << " circles lost" << std::endl;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "HoughCircleDetector.h"
+#include <string>
+#include <vector>
+
+// Outcome of one image of a batch, times in milliseconds
+struct BatchResult {
+
+	BatchResult(std::string input = std::string()) { this->input = input; }
+
+	std::string input;
+	std::string output;
+	std::string error; // empty when the image was processed
+	size_t bytes = 0;
+	double readTime = 0;
+	double detectTime = 0;
+	double writeTime = 0;
+	int tracked = 0;  // segments found again from the previous frame, in sequence mode
+	int searched = 0; // segments searched in full, in sequence mode
+	int lost = 0;     // circles of the previous frame not seen again
+};
+
+struct BatchOptions {
+
+	BatchOptions(int readers = 2, int detectors = 1, int writers = 2, int queueDepth = 2) {
+		this->readers = readers; this->detectors = detectors; this->writers = writers; this->queueDepth = queueDepth;
+	}
+
+	int readers;
+	int detectors; // each one runs its own HoughCircleDetector
+	int writers;
+	int queueDepth; // images waiting between two stages
+	bool gradientVoting = false;
+	int pyramid = 1; // see HoughCircleDetector::pyramid
+	bool pyramidRevote = true;
+	bool subPixel = false; // circles are the rounded refined ones
+	HoughEngine engine = FULL_HOUGH;
+	RadiusBand radii;
+	bool sequence = false; // frames of one sequence: one reader and one detector, tracking circles between frames
+	std::string outputDirectory; // results are not written when empty
+};
+
+// Paths listed one per line in a text file, or every .bmp file of a directory sorted by name
+std::vector <std::string> batchInputs(const char* listOrDirectory);
+
+// Detects circles in every input with a three stage pipeline: reader threads map and decode images,
+// detector threads find the circles and writer threads draw and encode the results. The bounded queues between
+// the stages cap how many images are in memory, while decoding image n + 1 and encoding image n - 1
+// overlap with the detection of image n. Images that fail to load or write are reported, not fatal.
+std::vector <BatchResult> runBatch(const std::vector <std::string>& inputs, BatchOptions options, double* wallTime);
+
+// Per image times followed by the aggregate throughput
+void printBatchReport(const std::vector <BatchResult>& results, double wallTime);
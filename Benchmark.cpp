@@ -0,0 +1,286 @@
+#include "BMP.h"
+#include "BinaryImage.h"
+#include "FrontEnd.h"
+#include "HoughCircleDetector.h"
+#include "Image.h"
+#include "RandomizedHough.h"
+#include "SimdKernels.h"
+#include "SyntheticImage.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Times of one stage over all repeats, in milliseconds
+struct StageTiming {
+
+	StageTiming(std::string name = std::string()) { this->name = name; }
+
+	double minimum() const { return times.empty() ? 0 : *std::min_element(times.begin(), times.end()); }
+
+	double median() const {
+		if (times.empty())
+			return 0;
+		std::vector <double> sorted = times;
+		std::sort(sorted.begin(), sorted.end());
+		return (sorted.size() % 2 == 1) ? sorted[sorted.size() / 2] : (sorted[sorted.size() / 2 - 1] + sorted[sorted.size() / 2]) / 2;
+	}
+
+	double mean() const {
+		double sum = 0;
+		for (double time : times)
+			sum += time;
+		return times.empty() ? 0 : sum / times.size();
+	}
+
+	std::string name;
+	std::vector <double> times;
+};
+
+// A whole detection of the generated image with one detector configuration
+struct EndToEndRun {
+
+	EndToEndRun(std::string config = std::string()) : timing(config) {}
+
+	StageTiming timing;
+	DetectionScore score;
+};
+
+struct ScaleResult {
+	int width = 0;
+	int height = 0;
+	int circles = 0;
+	std::vector <StageTiming> stages;
+	std::vector <EndToEndRun> runs;
+};
+
+struct BenchmarkSettings {
+	std::vector <std::pair<int, int>> scales = { {640, 480}, {1280, 720}, {1920, 1080}, {3840, 2160} };
+	int repeats = 5;
+	double density = 40; // circles per megapixel, unless circles is set
+	int circles = 0;
+	bool keepImages = false;
+	std::string output = "benchmark.json";
+	SyntheticOptions image;
+};
+
+// One warm-up run, then repeats timed runs; prepare restores the input of run and is not timed
+StageTiming timeStage(const char* name, int repeats, const std::function<void()>& prepare, const std::function<void()>& run) {
+
+	StageTiming timing(name);
+	for (int k = 0; k <= repeats; ++k) {
+		prepare();
+		auto tic = std::chrono::steady_clock::now();
+		run();
+		std::chrono::steady_clock::duration period = std::chrono::steady_clock::now() - tic;
+		if (k > 0)
+			timing.times.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(period).count() / (1000.0 * 1000.0));
+	}
+	return timing;
+}
+
+ScaleResult benchmarkScale(const BenchmarkSettings& settings, int width, int height) {
+
+	ScaleResult result;
+	result.width = width;
+	result.height = height;
+	auto nothing = [] {};
+
+	SyntheticOptions options = settings.image;
+	options.width = width;
+	options.height = height;
+	options.circles = (settings.circles > 0) ? settings.circles : std::max(1, (int)(settings.density * width * height / 1e6 + 0.5));
+	RgbImage rgb(width, height);
+	std::vector <RefinedCircle> truth = generateCircles(options, rgb);
+	result.circles = (int)truth.size();
+
+	std::string path = "benchmark_" + std::to_string(width) + "x" + std::to_string(height) + ".bmp";
+	Bmp bmp(width, height, false);
+	rgbToBmp(rgb, &bmp);
+	result.stages.push_back(timeStage("bmp_write", settings.repeats, nothing, [&] { bmp.write(path.c_str()); }));
+
+	GrayImage gray(width, height);
+	result.stages.push_back(timeStage("bmp_read", settings.repeats, nothing, [&] {
+		MappedBmp mapped(path.c_str());
+		mapped.toGray(gray);
+	}));
+
+	GrayImage log(width, height);
+	result.stages.push_back(timeStage("log", settings.repeats, nothing, [&] { laplacianOfGauss(gray, log); }));
+
+	int64_t histogram[DICRETE_LEVEL];
+	result.stages.push_back(timeStage("log_histogram", settings.repeats, nothing, [&] { laplacianOfGauss(gray, log, histogram); }));
+
+	result.stages.push_back(timeStage("histogram", settings.repeats, nothing, [&] { getHistogram(log, histogram); }));
+
+	int threshold = 0;
+	result.stages.push_back(timeStage("otsu", settings.repeats, nothing, [&] { threshold = threshold_Otsu(histogram); }));
+
+	FrontEnd frontEnd;
+	BinaryImage contours(width, height);
+	result.stages.push_back(timeStage("front_end", settings.repeats, nothing, [&] { frontEnd.run(gray, &contours); }));
+
+	std::vector <MorphOperation> morphology = HoughCircleDetector().morphology;
+	BinaryImage mask(width, height);
+	MorphBuffers buffers;
+	result.stages.push_back(timeStage("morphology", settings.repeats, [&] { mask.words = contours.words; },
+		[&] { morphSequence(&mask, morphology, &buffers); }));
+
+	LabelImage labels(width, height);
+	result.stages.push_back(timeStage("labeling", settings.repeats, nothing, [&] { segmentUnionFind(&mask, labels); }));
+
+	// removeExceptCircles erases the rejected segments from the labels, so every run starts from a copy
+	LabelImage labeled(width, height);
+	labeled.copy(labels);
+	std::vector <Segment> segments;
+	result.stages.push_back(timeStage("find_segments", settings.repeats, [&] { labels.view().copy(labeled); },
+		[&] { removeExceptCircles(labels, segments); }));
+
+	RadiusBand radii(10, std::min(MIN_RADIUS, options.minRadius), std::max(MAX_RADIUS, options.maxRadius + 1));
+	std::vector <Accumulator> accumulators;
+	result.stages.push_back(timeStage("find_circles", settings.repeats, nothing, [&] {
+		searchCircles(&contours, segments, DirectionView(), GRADIENT_TOLERANCE, accumulators, radii);
+	}));
+
+	RandomizedOptions randomized;
+	std::vector <RandomizedBuffers> randomizedBuffers;
+	result.stages.push_back(timeStage("find_circles_rht", settings.repeats, nothing, [&] {
+		std::vector <Segment> failed;
+		searchCirclesRandomized(&contours, segments, randomized, radii, randomizedBuffers, failed);
+	}));
+
+	// whole detections from the file, with the detector kept between repeats as a batch run keeps it
+	// the _subpixel runs refine their circles and are scored on the refined ones; pyramid4_subpixel votes at
+	// quarter resolution only
+	const char* configs[] = { "hough", "rht", "pyramid4", "hough_subpixel", "pyramid4_subpixel" };
+	for (const char* config : configs) {
+		HoughCircleDetector detector;
+		detector.radii = radii;
+		if (strcmp(config, "rht") == 0)
+			detector.engine = RANDOMIZED_HOUGH;
+		else if (strcmp(config, "pyramid4") == 0)
+			detector.pyramid = 4;
+		else if (strcmp(config, "hough_subpixel") == 0)
+			detector.subPixel = true;
+		else if (strcmp(config, "pyramid4_subpixel") == 0) {
+			detector.pyramid = 4;
+			detector.pyramidRevote = false;
+			detector.subPixel = true;
+		}
+		std::vector <CentersPoint> found;
+		EndToEndRun run(config);
+		run.timing = timeStage(config, settings.repeats, nothing, [&] {
+			MappedBmp mapped(path.c_str());
+			found = detector.detect(&mapped);
+		});
+		run.score = detector.subPixel ? scoreDetections(truth, detector.getRefinedCircles()) : scoreDetections(truth, found);
+		result.runs.push_back(run);
+	}
+
+	if (!settings.keepImages)
+		std::remove(path.c_str());
+	return result;
+}
+
+void writeTiming(std::ostream& out, const StageTiming& timing) {
+	out << "\"name\": \"" << timing.name << "\", \"min_ms\": " << timing.minimum() << ", \"median_ms\": " << timing.median()
+		<< ", \"mean_ms\": " << timing.mean();
+}
+
+void writeJson(std::ostream& out, const BenchmarkSettings& settings, const std::vector <ScaleResult>& results) {
+
+	const SyntheticOptions& image = settings.image;
+	out << "{\n  \"settings\": {\"repeats\": " << settings.repeats << ", \"simd\": \"" << simdLevelName(simdLevel()) << "\""
+		<< ", \"seed\": " << image.seed
+		<< ", \"min_radius\": " << image.minRadius << ", \"max_radius\": " << image.maxRadius
+		<< ", \"distribution\": \"" << ((image.distribution == NORMAL_RADII) ? "normal" : "uniform") << "\""
+		<< ", \"noise\": " << image.noise << ", \"overlap\": " << image.overlap << "},\n  \"scales\": [\n";
+	for (int s = 0; s < results.size(); ++s) {
+		const ScaleResult& result = results[s];
+		out << "    {\"width\": " << result.width << ", \"height\": " << result.height << ", \"circles\": " << result.circles
+			<< ",\n      \"stages\": [\n";
+		for (int n = 0; n < result.stages.size(); ++n) {
+			out << "        {";
+			writeTiming(out, result.stages[n]);
+			out << "}" << ((n + 1 < result.stages.size()) ? "," : "") << "\n";
+		}
+		out << "      ],\n      \"end_to_end\": [\n";
+		for (int n = 0; n < result.runs.size(); ++n) {
+			const DetectionScore& score = result.runs[n].score;
+			out << "        {";
+			writeTiming(out, result.runs[n].timing);
+			out << ", \"detected\": " << score.detected << ", \"matched\": " << score.matched << ", \"precision\": " << score.precision
+				<< ", \"recall\": " << score.recall << ", \"center_error\": " << score.centerError << ", \"radius_error\": "
+				<< score.radiusError << ", \"radius_bias\": " << score.radiusBias << "}" << ((n + 1 < result.runs.size()) ? "," : "") << "\n";
+		}
+		out << "      ]\n    }" << ((s + 1 < results.size()) ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+}
+
+// Parses "640x480,1920x1080"
+std::vector <std::pair<int, int>> parseScales(const char* text) {
+	std::vector <std::pair<int, int>> scales;
+	int width, height, length;
+	while (sscanf(text, "%dx%d%n", &width, &height, &length) == 2) {
+		scales.push_back(std::make_pair(width, height));
+		text += length;
+		if (*text != ',')
+			break;
+		++text;
+	}
+	return scales;
+}
+
+int main(int argc, char** argv) {
+
+	BenchmarkSettings settings;
+	for (int i = 1; i < argc; ++i)
+		if (strcmp(argv[i], "--scales") == 0 && i + 1 < argc)
+			settings.scales = parseScales(argv[++i]);
+		else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc)
+			settings.repeats = std::max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "--density") == 0 && i + 1 < argc)
+			settings.density = atof(argv[++i]);
+		else if (strcmp(argv[i], "--circles") == 0 && i + 1 < argc)
+			settings.circles = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--radii") == 0 && i + 2 < argc) {
+			settings.image.minRadius = atoi(argv[++i]);
+			settings.image.maxRadius = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--normal") == 0)
+			settings.image.distribution = NORMAL_RADII;
+		else if (strcmp(argv[i], "--noise") == 0 && i + 1 < argc)
+			settings.image.noise = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--overlap") == 0 && i + 1 < argc)
+			settings.image.overlap = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			settings.image.seed = strtoull(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+			settings.output = argv[++i];
+		else if (strcmp(argv[i], "--keep-images") == 0)
+			settings.keepImages = true;
+
+	std::cout << "simd: " << simdLevelName(simdLevel()) << std::endl;
+	std::vector <ScaleResult> results;
+	for (const std::pair<int, int>& scale : settings.scales) {
+		results.push_back(benchmarkScale(settings, scale.first, scale.second));
+		const ScaleResult& result = results.back();
+		std::cout << result.width << "x" << result.height << ", " << result.circles << " circles" << std::endl;
+		for (const StageTiming& stage : result.stages)
+			std::cout << "  " << stage.name << ": " << stage.median() << " ms" << std::endl;
+		for (const EndToEndRun& run : result.runs)
+			std::cout << "  " << run.timing.name << ": " << run.timing.median() << " ms, recall " << run.score.recall
+				<< ", precision " << run.score.precision << std::endl;
+	}
+
+	std::ofstream out(settings.output);
+	writeJson(out, settings, results);
+	return 0;
+}
@@ -0,0 +1,233 @@
+#include "BinaryImage.h"
+#include "Image.h"
+#include "SimdKernels.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
+
+BinaryImage::BinaryImage(int width, int height) {
+	resize(width, height);
+}
+
+void BinaryImage::resize(int width, int height) {
+	this->width_ = width;
+	this->height_ = height;
+	this->wordsPerRow_ = (width + 63) / 64;
+	words.assign((size_t)wordsPerRow_ * height, 0);
+}
+
+BinaryImage::BinaryImage(GrayView image) : BinaryImage(image.getWidth(), image.getHeight()) {
+	parallelRows(height_, ROW_GRAIN, [&](int firstRow, int endRow) {
+		for (int j = firstRow; j < endRow; ++j) {
+			uint64_t* bits = row(j);
+			uint8_t* pixels = image.row(j);
+			for (int i = 0; i < width_; ++i)
+				if (pixels[i] > 0)
+					bits[i >> 6] |= (uint64_t)1 << (i & 63);
+		}
+	});
+}
+
+void BinaryImage::unpack(GrayView image) {
+	parallelRows(height_, ROW_GRAIN, [&](int firstRow, int endRow) {
+		for (int j = firstRow; j < endRow; ++j) {
+			uint64_t* bits = row(j);
+			uint8_t* pixels = image.row(j);
+			for (int i = 0; i < width_; ++i)
+				pixels[i] = ((bits[i >> 6] >> (i & 63)) & 1) ? 255 : 0;
+		}
+	});
+}
+
+void inverseValues(BinaryImage* image) {
+
+	uint64_t tail = image->lastWordMask();
+	int wordsPerRow = image->getWordsPerRow();
+
+	parallelRows(image->getHeight(), ROW_GRAIN, [&](int firstRow, int endRow) {
+		for (int j = firstRow; j < endRow; ++j) {
+			uint64_t* bits = image->row(j);
+			for (int w = 0; w < wordsPerRow; ++w)
+				bits[w] = ~bits[w];
+			bits[wordsPerRow - 1] &= tail;
+		}
+	});
+}
+
+void paintBorders(BinaryImage* image, int width) {
+
+	int imageWidth = image->getWidth();
+	int imageHeight = image->getHeight();
+
+	for (int j = 0; j < width && j < imageHeight; ++j) {
+		std::fill(image->row(j), image->row(j) + image->getWordsPerRow(), 0);
+		std::fill(image->row(imageHeight - j - 1), image->row(imageHeight - j - 1) + image->getWordsPerRow(), 0);
+	}
+
+	for (int j = 0; j < imageHeight; ++j)
+		for (int i = 0; i < width && i < imageWidth; ++i) {
+			image->clear(i, j);
+			image->clear(imageWidth - i - 1, j);
+		}
+}
+
+// Packs every factor-th bit of bits, starting with bit 0, into the low bits; factor is 2 or 4
+uint64_t gatherBits(uint64_t bits, int factor) {
+	if (factor == 2) {
+		bits &= 0x5555555555555555ull;
+		bits = (bits | (bits >> 1)) & 0x3333333333333333ull;
+		bits = (bits | (bits >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+		bits = (bits | (bits >> 4)) & 0x00FF00FF00FF00FFull;
+		bits = (bits | (bits >> 8)) & 0x0000FFFF0000FFFFull;
+		return (bits | (bits >> 16)) & 0x00000000FFFFFFFFull;
+	}
+	bits &= 0x1111111111111111ull;
+	bits = (bits | (bits >> 3)) & 0x0303030303030303ull;
+	bits = (bits | (bits >> 6)) & 0x000F000F000F000Full;
+	bits = (bits | (bits >> 12)) & 0x000000FF000000FFull;
+	return (bits | (bits >> 24)) & 0x000000000000FFFFull;
+}
+
+void downsample(BinaryImage* image, int factor, BinaryImage* result) {
+	TRACE_SCOPE("downsample");
+
+	int width = image->getWidth();
+	int height = image->getHeight();
+	int wordsPerRow = image->getWordsPerRow();
+	result->resize((width + factor - 1) / factor, (height + factor - 1) / factor);
+
+	// the rows of a block are merged first, then the columns: for factors 2 and 4 a word at a time,
+	// by folding each block onto its first bit and gathering those bits
+	std::vector <uint64_t> merged(wordsPerRow);
+	for (int j = 0; j < result->getHeight(); ++j) {
+		std::fill(merged.begin(), merged.end(), 0);
+		for (int k = j * factor; k < std::min((j + 1) * factor, height); ++k) {
+			uint64_t* bits = image->row(k);
+			for (int w = 0; w < wordsPerRow; ++w)
+				merged[w] |= bits[w];
+		}
+		uint64_t* out = result->row(j);
+		if (factor == 2 || factor == 4)
+			for (int w = 0; w < wordsPerRow; ++w) {
+				uint64_t bits = merged[w];
+				for (int shift = 1; shift < factor; ++shift)
+					bits |= merged[w] >> shift;
+				int x = w * 64 / factor;
+				out[x >> 6] |= gatherBits(bits, factor) << (x & 63);
+			}
+		else
+			for (int w = 0; w < wordsPerRow; ++w)
+				for (uint64_t bits = merged[w]; bits != 0; bits &= bits - 1)
+					result->set((w * 64 + lowestBit(bits)) / factor, j);
+	}
+}
+
+// dst pixel x becomes src pixel x + shift, pixels shifted in from outside src are 0
+void shiftRow(const uint64_t* src, int srcWords, uint64_t* dst, int dstWords, int shift) {
+	int wordShift = (shift >= 0) ? shift / 64 : -((-shift + 63) / 64);
+	int bitShift = shift - wordShift * 64;
+
+	for (int w = 0; w < dstWords; ++w) {
+		int s = w + wordShift;
+		uint64_t low = (s >= 0 && s < srcWords) ? src[s] : 0;
+		uint64_t high = (s + 1 >= 0 && s + 1 < srcWords) ? src[s + 1] : 0;
+		dst[w] = (bitShift == 0) ? low : ((low >> bitShift) | (high << (64 - bitShift)));
+	}
+}
+
+// OR of every window [x - before, x + after] x [y - before, y + after], 64 pixels per operation.
+// The image is padded by the window on both sides, and a window of any length is covered by two
+// overlapping runs of the largest power of two it holds. Runs are built by doubling, so the cost
+// grows with log(size) instead of size.
+void windowOr(BinaryImage* source, BinaryImage* result, int before, int after, MorphBuffers* buffers) {
+
+	int height = source->getHeight();
+	int wordsPerRow = source->getWordsPerRow();
+	uint64_t tail = source->lastWordMask();
+
+	int window = before + after + 1;
+	int run = 1;
+	while (run * 2 <= window)
+		run *= 2;
+
+	// horizontal runs, row by row
+	int paddedWords = (source->getWidth() + window - 1 + 63) / 64;
+	std::vector <uint64_t>& padded = buffers->padded;
+	std::vector <uint64_t>& shifted = buffers->shifted;
+	padded.resize(paddedWords);
+	shifted.resize(paddedWords);
+	for (int j = 0; j < height; ++j) {
+		shiftRow(source->row(j), wordsPerRow, padded.data(), paddedWords, -before);
+		for (int step = 1; step < run; step *= 2) {
+			shiftRow(padded.data(), paddedWords, shifted.data(), paddedWords, step);
+			orWords(padded.data(), padded.data(), shifted.data(), paddedWords);
+		}
+		uint64_t* out = result->row(j);
+		shiftRow(padded.data(), paddedWords, shifted.data(), paddedWords, window - run);
+		orWords(out, padded.data(), shifted.data(), wordsPerRow);
+		out[wordsPerRow - 1] &= tail;
+	}
+
+	// vertical runs over whole rows; padded row e holds image row e - before
+	int paddedRows = height + window - 1;
+	std::vector <uint64_t>& rows = buffers->rows;
+	rows.assign((size_t)paddedRows * wordsPerRow, 0);
+	std::copy(result->words.begin(), result->words.end(), rows.begin() + (size_t)before * wordsPerRow);
+	for (int step = 1; step < run; step *= 2)
+		for (int e = 0; e + step < paddedRows; ++e) {
+			uint64_t* bits = rows.data() + (size_t)e * wordsPerRow;
+			uint64_t* below = bits + (size_t)step * wordsPerRow;
+			orWords(bits, bits, below, wordsPerRow);
+		}
+	for (int j = 0; j < height; ++j) {
+		uint64_t* out = result->row(j);
+		uint64_t* first = rows.data() + (size_t)j * wordsPerRow;
+		uint64_t* second = first + (size_t)(window - run) * wordsPerRow;
+		orWords(out, first, second, wordsPerRow);
+	}
+}
+
+void morphSequence(BinaryImage* image, const std::vector <MorphOperation>& operations) {
+	MorphBuffers buffers;
+	morphSequence(image, operations, &buffers);
+}
+
+void morphSequence(BinaryImage* image, const std::vector <MorphOperation>& operations, MorphBuffers* buffers) {
+	TRACE_SCOPE("morphSequence");
+
+	int width = image->getWidth();
+	int height = image->getHeight();
+	int wordsPerRow = image->getWordsPerRow();
+
+	BinaryImage& source = buffers->source;
+	BinaryImage& spread = buffers->spread;
+	BinaryImage& interior = buffers->interior;
+	source.resize(width, height);
+	spread.resize(width, height);
+	interior.resize(width, 1);
+
+	for (const MorphOperation& operation : operations) {
+		int spc = (operation.size % 2 == 1) ? ((operation.size - 1) / 2) : (operation.size / 2); //spacing
+		bool dilation = (operation.type == DILATION);
+		if (spc < 1)
+			continue;
+
+		// only pixels at least spc away from the image border spread to the window [p - spc + 1, p + spc];
+		// erosion spreads the background, so it works on the inverted image
+		std::fill(interior.words.begin(), interior.words.end(), 0);
+		for (int i = spc; i < width - spc; ++i)
+			interior.set(i, 0);
+		std::fill(source.words.begin(), source.words.end(), 0);
+		for (int j = spc; j < height - spc; ++j) {
+			uint64_t* bits = image->row(j);
+			uint64_t* out = source.row(j);
+			for (int w = 0; w < wordsPerRow; ++w)
+				out[w] = (dilation ? bits[w] : ~bits[w]) & interior.words[w];
+		}
+
+		windowOr(&source, &spread, spc - 1, spc, buffers);
+
+		for (size_t w = 0; w < image->words.size(); ++w)
+			image->words[w] = dilation ? (image->words[w] | spread.words[w]) : (image->words[w] & ~spread.words[w]);
+	}
+}
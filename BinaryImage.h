@@ -0,0 +1,74 @@
+#pragma once
+
+#include "BMP.h"
+#include <cstdint>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit, bits must not be 0
+inline int lowestBit(uint64_t bits) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, bits);
+	return (int)index;
+#else
+	return __builtin_ctzll(bits);
+#endif
+}
+
+// Black and white image with one bit per pixel. Pixel x of a row is bit x % 64 of word x / 64,
+// every row starts on a new word and the bits past the image width are always 0.
+struct BinaryImage {
+
+	BinaryImage(int width, int height);
+
+	// Contents are cleared
+	void resize(int width, int height);
+
+	// Every pixel greater than 0 becomes set
+	BinaryImage(GrayView image);
+
+	int getWidth() { return this->width_; }
+	int getHeight() { return this->height_; }
+	int getWordsPerRow() { return this->wordsPerRow_; }
+
+	uint64_t* row(int y) { return words.data() + (size_t)y * wordsPerRow_; }
+
+	bool get(int x, int y) { return (row(y)[x >> 6] >> (x & 63)) & 1; }
+
+	void set(int x, int y) { row(y)[x >> 6] |= (uint64_t)1 << (x & 63); }
+
+	void clear(int x, int y) { row(y)[x >> 6] &= ~((uint64_t)1 << (x & 63)); }
+
+	// Writes 255 for set pixels and 0 for the others into an image of the same size
+	void unpack(GrayView image);
+
+	// Mask of the valid bits in the last word of a row
+	uint64_t lastWordMask() { return (width_ % 64 == 0) ? ~(uint64_t)0 : (((uint64_t)1 << (width_ % 64)) - 1); }
+
+	std::vector <uint64_t> words;
+
+private:
+	int width_;
+	int height_;
+	int wordsPerRow_;
+};
+
+// Each pixel of result is set when any pixel of its factor x factor block of image is set
+void downsample(BinaryImage* image, int factor, BinaryImage* result);
+
+// Working memory of the packed morphology, kept by callers that run it on frame after frame
+struct MorphBuffers {
+
+	MorphBuffers() : source(0, 0), spread(0, 0), interior(0, 0) {}
+
+	BinaryImage source;
+	BinaryImage spread;
+	BinaryImage interior;
+	std::vector <uint64_t> padded;
+	std::vector <uint64_t> shifted;
+	std::vector <uint64_t> rows;
+};
@@ -0,0 +1,186 @@
+#include "CircleRefinement.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+CentersPoint RefinedCircle::toCentersPoint(int count) const {
+	CentersPoint point(Point((int)lround(x), (int)lround(y)), (int)lround(radius));
+	point.count = count;
+	return point;
+}
+
+double parabolaOffset(double before, double peak, double after) {
+
+	double curvature = before - 2 * peak + after;
+	if (peak < before || peak < after || curvature >= 0)
+		return 0;
+	double offset = 0.5 * (before - after) / curvature;
+	return std::min(std::max(offset, -0.5), 0.5);
+}
+
+RefinedCircle interpolatePeak(Accumulator& accumulator, const CentersPoint& peak, int scale) {
+
+	// votes only land strictly inside the borders
+	Rect borders = accumulator.getBorders();
+	int x = peak.point.x;
+	int y = peak.point.y;
+	int r = peak.radius;
+	double middle = accumulator.getVotes(x, y, r);
+
+	double dx = 0, dy = 0, dr = 0;
+	if (x - 1 > borders.min.x && x + 1 < borders.max.x)
+		dx = parabolaOffset(accumulator.getVotes(x - 1, y, r), middle, accumulator.getVotes(x + 1, y, r));
+	if (y - 1 > borders.min.y && y + 1 < borders.max.y)
+		dy = parabolaOffset(accumulator.getVotes(x, y - 1, r), middle, accumulator.getVotes(x, y + 1, r));
+	if (r - 1 >= accumulator.getMinRadius() && r + 1 < accumulator.getMaxRadius())
+		dr = parabolaOffset(accumulator.getVotes(x, y, r - 1), middle, accumulator.getVotes(x, y, r + 1));
+
+	double offset = (scale - 1) / 2.0;
+	return RefinedCircle((x + dx) * scale + offset, (y + dy) * scale + offset, (r + dr) * scale);
+}
+
+RefinedCircle revoteCircle(BinaryImage* contours, const CentersPoint& circle, const RefineOptions& options, Accumulator* window,
+	DirectionView directions, int angleTolerance) {
+	TRACE_SCOPE("revoteCircle");
+
+	int width = contours->getWidth();
+	int height = contours->getHeight();
+	int reach = options.reach;
+
+	// votes never land on the edge of the window, so it is one pixel wider than the reach
+	Rect borders(Point(std::max(circle.point.x - reach - 1, 0), std::max(circle.point.y - reach - 1, 0)),
+		Point(std::min(circle.point.x + reach + 1, width - 1), std::min(circle.point.y + reach + 1, height - 1)));
+	int minRadius = std::max(circle.radius - reach, 1);
+	int maxRadius = circle.radius + reach + 1;
+	window->reset(borders, minRadius, maxRadius);
+
+	// only contour pixels that can reach the window vote
+	int extent = maxRadius + reach + 1;
+	Rect voters(Point(circle.point.x - extent, circle.point.y - extent), Point(circle.point.x + extent, circle.point.y + extent));
+	for (int k = minRadius; k < maxRadius; ++k)
+		centerInWindow(contours, window, k, voters, directions, angleTolerance);
+
+	CentersPoint peak = window->peak();
+	if (peak.count == 0)
+		return RefinedCircle(circle.point.x, circle.point.y, circle.radius);
+	return interpolatePeak(*window, peak);
+}
+
+double determinant3(const double m[3][3]) {
+	return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+		- m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+		+ m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+}
+
+struct EdgePoint {
+	double x;
+	double y;
+};
+
+// Bilinear gray value at (x, y), which must lie inside the image
+double sampleGray(GrayView gray, double x, double y) {
+	int x0 = std::min((int)x, gray.getWidth() - 2);
+	int y0 = std::min((int)y, gray.getHeight() - 2);
+	double fx = x - x0;
+	double fy = y - y0;
+	const uint8_t* top = gray.row(y0) + x0;
+	const uint8_t* bottom = gray.row(y0 + 1) + x0;
+	return (top[0] * (1 - fx) + top[1] * fx) * (1 - fy) + (bottom[0] * (1 - fx) + bottom[1] * fx) * fy;
+}
+
+// Edge points around circle, see fitCircle; rays leaving the image or without a step of at least
+// options.minGradient give none
+void findEdgePoints(GrayView gray, const RefinedCircle& circle, const RefineOptions& options, std::vector <EdgePoint>& points) {
+
+	// the profile along a ray is sampled every half pixel, two samples beyond the band on either side
+	const double step = 0.5;
+	int samples = (int)ceil(2 * options.band / step) + 5;
+	double start = circle.radius - options.band - 2 * step;
+	std::vector <double> profile(samples);
+	std::vector <double> slope(samples);
+
+	points.clear();
+	int rays = std::max((int)ceil(2 * PI * circle.radius), 16);
+	for (int n = 0; n < rays; ++n) {
+		double angle = 2 * PI * n / rays;
+		double cosine = cos(angle);
+		double sine = sin(angle);
+		double firstX = circle.x + start * cosine;
+		double firstY = circle.y + start * sine;
+		double lastX = circle.x + (start + (samples - 1) * step) * cosine;
+		double lastY = circle.y + (start + (samples - 1) * step) * sine;
+		if (std::min(firstX, lastX) < 0 || std::min(firstY, lastY) < 0 || std::max(firstX, lastX) > gray.getWidth() - 1
+			|| std::max(firstY, lastY) > gray.getHeight() - 1)
+			continue;
+
+		for (int k = 0; k < samples; ++k)
+			profile[k] = sampleGray(gray, circle.x + (start + k * step) * cosine, circle.y + (start + k * step) * sine);
+		int best = 0;
+		for (int k = 1; k < samples - 1; ++k) {
+			slope[k] = fabs(profile[k + 1] - profile[k - 1]) / (2 * step);
+			if (best == 0 || slope[k] > slope[best])
+				best = k;
+		}
+		// the step has to lie inside the band, with a neighbour on each side for the parabola
+		if (best < 2 || best > samples - 3 || slope[best] < options.minGradient)
+			continue;
+		double distance = start + (best + parabolaOffset(slope[best - 1], slope[best], slope[best + 1])) * step;
+		points.push_back(EdgePoint{ circle.x + distance * cosine, circle.y + distance * sine });
+	}
+}
+
+int fitCircle(GrayView gray, RefinedCircle& circle, const RefineOptions& options) {
+	TRACE_SCOPE("fitCircle");
+
+	RefinedCircle current = circle;
+	std::vector <EdgePoint> points;
+	int support = 0;
+	for (int k = 0; k < options.iterations; ++k) {
+		findEdgePoints(gray, current, options, points);
+
+		// sums of the normal equations, in coordinates relative to the current center
+		double sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0, sz = 0, sxz = 0, syz = 0;
+		int count = (int)points.size();
+		for (const EdgePoint& point : points) {
+			double dx = point.x - current.x;
+			double dy = point.y - current.y;
+			double z = dx * dx + dy * dy;
+			sx += dx; sy += dy;
+			sxx += dx * dx; syy += dy * dy; sxy += dx * dy;
+			sz += z; sxz += dx * z; syz += dy * z;
+		}
+		if (count < options.minSupport)
+			return 0;
+
+		// normal equations for (D, E, F), solved by Cramer's rule
+		double matrix[3][3] = { { sxx, sxy, sx }, { sxy, syy, sy }, { sx, sy, (double)count } };
+		double right[3] = { -sxz, -syz, -sz };
+		double determinant = determinant3(matrix);
+		if (fabs(determinant) < 1e-9)
+			return 0;
+		double solution[3];
+		for (int column = 0; column < 3; ++column) {
+			double replaced[3][3];
+			for (int row = 0; row < 3; ++row)
+				for (int j = 0; j < 3; ++j)
+					replaced[row][j] = (j == column) ? right[row] : matrix[row][j];
+			solution[column] = determinant3(replaced) / determinant;
+		}
+		double d = solution[0];
+		double e = solution[1];
+		double f = solution[2];
+		double squared = (d * d + e * e) / 4 - f;
+		if (squared <= 0)
+			return 0;
+		current = RefinedCircle(current.x - d / 2, current.y - e / 2, sqrt(squared));
+		support = count;
+	}
+
+	double shift = sqrt((current.x - circle.x) * (current.x - circle.x) + (current.y - circle.y) * (current.y - circle.y));
+	if (shift > options.maxShift || fabs(current.radius - circle.radius) > options.maxShift)
+		return 0;
+	circle = current;
+	circle.support = support;
+	return support;
+}
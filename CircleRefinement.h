@@ -0,0 +1,51 @@
+#pragma once
+
+#include "BinaryImage.h"
+#include "Image.h"
+
+// Circle with a sub-pixel center and radius, in pixels of the full resolution image
+struct RefinedCircle {
+
+	RefinedCircle(double x = 0, double y = 0, double radius = 0) { this->x = x; this->y = y; this->radius = radius; }
+
+	// Nearest integer circle, for the callers of the integer results
+	CentersPoint toCentersPoint(int count) const;
+
+	double x;
+	double y;
+	double radius;
+	int support = 0; // edge points of the least squares fit, 0 when the fit was not used
+};
+
+struct RefineOptions {
+	int reach = 2;            // pixels and radii around an integer circle voted again to find its peak
+	bool fit = true;          // least squares fit to the gray edge around the interpolated circle
+	double band = 2.0;        // distance inside and outside the circle within which the edge is looked for
+	int iterations = 3;       // fits, each looking for the edge around the circle of the previous one
+	int minSupport = 24;      // fewer edge points than this keep the interpolated circle
+	double minGradient = 8.0; // weakest edge giving a point, in gray levels per pixel
+	double maxShift = 2.0;    // a fit moving center or radius further than this is rejected
+};
+
+// Vertex of the parabola through three votes around a peak, as an offset of -0.5..0.5 from the middle;
+// 0 when the middle is not a maximum
+double parabolaOffset(double before, double peak, double after);
+
+// Sub-pixel position of an accumulator peak, one parabola along x, y and the radius each. An axis without
+// a voted neighbour on both sides keeps the integer value. For an accumulator over contours downsampled by
+// scale, the result is in full resolution pixels: coarse pixel c covers pixels c * scale .. c * scale + scale - 1.
+RefinedCircle interpolatePeak(Accumulator& accumulator, const CentersPoint& peak, int scale = 1);
+
+// Votes again for the centers within options.reach of circle and the radii within options.reach of its
+// radius, and interpolates the peak of that small accumulator. window is working memory; with directions
+// the votes follow the gradients as in centerInWindow. Call prepareStencils for the radii first.
+RefinedCircle revoteCircle(BinaryImage* contours, const CentersPoint& circle, const RefineOptions& options, Accumulator* window,
+	DirectionView directions = DirectionView(), int angleTolerance = GRADIENT_TOLERANCE);
+
+// Kasa fit: the circle x^2 + y^2 + D x + E y + F = 0 nearest, in least squares, to sub-pixel edge points
+// of the gray image around circle, repeated options.iterations times. There is an edge point per pixel of
+// the circumference: along a ray from the center, the steepest gray step within options.band of the
+// radius, placed with a parabola. The contour pixels are not used, their ring lies beside the edge and
+// would bias the radius. Returns the points of the last fit; circle is left as it is when they are fewer
+// than options.minSupport or the fit moves further than options.maxShift.
+int fitCircle(GrayView gray, RefinedCircle& circle, const RefineOptions& options);
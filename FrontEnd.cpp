@@ -0,0 +1,219 @@
+#include "FrontEnd.h"
+#include "Image.h"
+#include "SimdKernels.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <mutex>
+
+// Bands recompute the LoG of four rows and carry a raw histogram each, so they are kept large
+const int FRONT_END_GRAIN = 64;
+
+void FrontEnd::RawStatistics::clear() {
+	histogram.assign(2 * LOG_RANGE + 1, 0);
+	min = INT_MAX;
+	max = INT_MIN;
+}
+
+void FrontEnd::RawStatistics::add(const int16_t* log, int width) {
+
+	for (int i = 0; i < width; ++i) {
+		min = std::min(min, (int)log[i]);
+		max = std::max(max, (int)log[i]);
+		histogram[log[i] + LOG_RANGE]++;
+	}
+}
+
+void FrontEnd::RawStatistics::merge(const RawStatistics& other) {
+
+	if (other.min > other.max)
+		return;
+	min = std::min(min, other.min);
+	max = std::max(max, other.max);
+	for (int v = other.min; v <= other.max; ++v)
+		histogram[v + LOG_RANGE] += other.histogram[v + LOG_RANGE];
+}
+
+template <typename RowDecoder, typename RowOutput>
+void FrontEnd::logRows(int width, int height, int firstRow, int endRow, RowDecoder decode, RowOutput output) {
+
+	std::vector <uint8_t> grayRow(width);
+	std::vector <int16_t> out(width);
+
+	int stride = width + 2 * LOG_PADDING;
+	std::vector <int16_t> ring((size_t)6 * stride, 0);
+	const int16_t* zeroRow = ring.data() + (size_t)5 * stride + LOG_PADDING;
+	auto ringRow = [&](int y) { return ring.data() + (size_t)(y % 5) * stride + LOG_PADDING; };
+	auto loadRow = [&](int y) {
+		const uint8_t* gray = decode(y, grayRow.data());
+		int16_t* row = ringRow(y);
+		for (int i = 0; i < width; ++i)
+			row[i] = gray[i];
+	};
+
+	for (int y = std::max(firstRow - 2, 0); y < firstRow + 2 && y < height; ++y)
+		loadRow(y);
+
+	for (int y = firstRow; y < endRow; ++y) {
+		if (y + 2 < height)
+			loadRow(y + 2);
+
+		const int16_t* rows[5];
+		for (int k = 0; k < 5; ++k)
+			rows[k] = (y - 2 + k >= 0 && y - 2 + k < height) ? ringRow(y - 2 + k) : zeroRow;
+		logRow(rows, out.data(), width);
+		output(y, out.data());
+	}
+}
+
+void FrontEnd::findThreshold(int width, int height) {
+
+	width_ = width;
+	height_ = height;
+	int min = raw_.min;
+	int max = raw_.max;
+
+	// histogram of the normalized image, same rounding as laplacianOfGauss
+	int64_t histogram[DICRETE_LEVEL] = { 0 };
+	std::vector <uint8_t> table(max - min + 1, 0);
+	for (int v = min; v <= max; ++v) {
+		if (max > min)
+			table[v - min] = (uint8_t)round(((float)v - (float)min) / ((float)max - (float)min) * 255.0);
+		histogram[table[v - min]] += raw_.histogram[v + LOG_RANGE];
+	}
+	threshold_ = threshold_Otsu(histogram);
+
+	// a pixel is a contour when its normalized value is below the threshold, i.e. its raw value is below
+	// the first raw value that normalizes to the threshold or more
+	int limit = (int)(multiplier * threshold_);
+	rawLimit_ = max + 1;
+	for (int v = min; v <= max; ++v)
+		if (table[v - min] >= limit) {
+			rawLimit_ = v;
+			break;
+		}
+}
+
+void FrontEnd::thresholdRow(const int16_t* log, int y, uint64_t* bits) {
+
+	if (y < borderWidth || y >= height_ - borderWidth) {
+		std::fill(bits, bits + (width_ + 63) / 64, 0);
+		return;
+	}
+	lessThanToBits(log, width_, (int16_t)rawLimit_, bits);
+	for (int i = 0; i < borderWidth && i < width_; ++i) {
+		bits[i >> 6] &= ~((uint64_t)1 << (i & 63));
+		bits[(width_ - i - 1) >> 6] &= ~((uint64_t)1 << ((width_ - i - 1) & 63));
+	}
+}
+
+void FrontEnd::thresholdAll(BinaryImage* contours) {
+
+	if (contours->getWidth() != width_ || contours->getHeight() != height_)
+		contours->resize(width_, height_);
+	parallelRows(height_, ROW_GRAIN, [&](int firstRow, int endRow) {
+		for (int y = firstRow; y < endRow; ++y)
+			thresholdRow(log_.row(y), y, contours->row(y));
+	});
+}
+
+void FrontEnd::run(MappedBmp* bmpImage, BinaryImage* contours, GrayView gray) {
+	TRACE_SCOPE("FrontEnd::run");
+
+	int channels = bmpImage->bmp_info_header.bit_count / 8;
+	int width = bmpImage->getWidth();
+	int height = bmpImage->getHeight();
+
+	log_.resize(width, height);
+	raw_.clear();
+	std::mutex mutex;
+	parallelRows(height, FRONT_END_GRAIN, [&](int firstRow, int endRow) {
+		RawStatistics band;
+		band.clear();
+		// rows around the band are decoded by the neighbouring bands as well, so only the own rows go to gray
+		logRows(width, height, firstRow, endRow, [&](int y, uint8_t* buffer) {
+			uint8_t* target = (gray.isEmpty() || y < firstRow || y >= endRow) ? buffer : gray.row(y);
+			bgrToGrayRow(bmpImage->row(y), channels, target, width);
+			return (const uint8_t*)target;
+		}, [&](int y, const int16_t* log) {
+			std::copy(log, log + width, log_.row(y));
+			band.add(log, width);
+		});
+		std::lock_guard<std::mutex> lock(mutex);
+		raw_.merge(band);
+	});
+	findThreshold(width, height);
+	thresholdAll(contours);
+}
+
+void FrontEnd::run(GrayView image, BinaryImage* contours) {
+	TRACE_SCOPE("FrontEnd::run");
+
+	int width = image.getWidth();
+	int height = image.getHeight();
+
+	log_.resize(width, height);
+	raw_.clear();
+	std::mutex mutex;
+	parallelRows(height, FRONT_END_GRAIN, [&](int firstRow, int endRow) {
+		RawStatistics band;
+		band.clear();
+		logRows(width, height, firstRow, endRow, [&](int y, uint8_t*) {
+			return (const uint8_t*)image.row(y);
+		}, [&](int y, const int16_t* log) {
+			std::copy(log, log + width, log_.row(y));
+			band.add(log, width);
+		});
+		std::lock_guard<std::mutex> lock(mutex);
+		raw_.merge(band);
+	});
+	findThreshold(width, height);
+	thresholdAll(contours);
+}
+
+void FrontEnd::measure(MappedBmp* bmpImage) {
+	TRACE_SCOPE("FrontEnd::measure");
+
+	int channels = bmpImage->bmp_info_header.bit_count / 8;
+	int width = bmpImage->getWidth();
+	int height = bmpImage->getHeight();
+
+	raw_.clear();
+	std::mutex mutex;
+	parallelRows(height, FRONT_END_GRAIN, [&](int firstRow, int endRow) {
+		RawStatistics band;
+		band.clear();
+		logRows(width, height, firstRow, endRow, [&](int y, uint8_t* buffer) {
+			bgrToGrayRow(bmpImage->row(y), channels, buffer, width);
+			return (const uint8_t*)buffer;
+		}, [&](int, const int16_t* log) {
+			band.add(log, width);
+		});
+		std::lock_guard<std::mutex> lock(mutex);
+		raw_.merge(band);
+	});
+	findThreshold(width, height);
+}
+
+void FrontEnd::streamContours(MappedBmp* bmpImage, const std::function<void(int y, const uint64_t* contours, const uint8_t* gray)>& output) {
+	TRACE_SCOPE("FrontEnd::streamContours");
+
+	int channels = bmpImage->bmp_info_header.bit_count / 8;
+	int width = bmpImage->getWidth();
+	int height = bmpImage->getHeight();
+
+	// the LoG of row y is ready once row y + 2 is decoded, so the gray rows wait in a small ring
+	const int delay = 3;
+	GrayImage grayRows(width, delay);
+	std::vector <uint64_t> bits((width + 63) / 64);
+	logRows(width, height, 0, height, [&](int y, uint8_t*) {
+		uint8_t* target = grayRows.row(y % delay);
+		bgrToGrayRow(bmpImage->row(y), channels, target, width);
+		return (const uint8_t*)target;
+	}, [&](int y, const int16_t* log) {
+		thresholdRow(log, y, bits.data());
+		output(y, bits.data(), grayRows.row(y % delay));
+	});
+}
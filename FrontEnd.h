@@ -0,0 +1,75 @@
+#pragma once
+
+#include "BMP.h"
+#include "BinaryImage.h"
+#include <functional>
+#include <vector>
+
+// Largest magnitude the 5x5 LoG kernel produces on 8-bit input
+const int LOG_RANGE = 16 * 255;
+
+// Fused front end of the pipeline: gray conversion, LoG, normalization, Otsu threshold, inversion and
+// border clearing in two streaming passes.
+//   pass 1: decodes rows into a 5-row ring, runs the LoG on it and stores the 16-bit result while
+//           tracking the value range and a histogram of the raw LoG values;
+//   pass 2: the normalized histogram and the Otsu threshold follow from the raw one, and because
+//           normalization is monotonic the threshold becomes a single comparison on the stored values,
+//           written straight into the packed contour mask.
+// The result equals laplacianOfGauss, thresholdImage, inverseValues and paintBorders run one after
+// another. Both passes of run and measure work on bands of rows in parallel, each band with its own ring
+// and statistics; streamContours keeps to one band so the rows leave in order.
+struct FrontEnd {
+
+	FrontEnd(float multiplier = 1.0, int borderWidth = 2) { this->multiplier = multiplier; this->borderWidth = borderWidth; }
+
+	// When gray is not empty it receives the decoded grayscale image
+	void run(MappedBmp* bmpImage, BinaryImage* contours, GrayView gray = GrayView());
+
+	void run(GrayView image, BinaryImage* contours);
+
+	// Streaming variant for images that do not fit in memory: measure finds the threshold without keeping
+	// the LoG, then streamContours recomputes it and hands every contour row, together with its gray row,
+	// to output in top to bottom order. Memory stays a few rows wide.
+	void measure(MappedBmp* bmpImage);
+
+	void streamContours(MappedBmp* bmpImage, const std::function<void(int y, const uint64_t* contours, const uint8_t* gray)>& output);
+
+	// Otsu threshold on the normalized LoG found by the last run
+	int getThreshold() { return threshold_; }
+
+	float multiplier;
+	int borderWidth;
+
+private:
+	// Range and histogram of raw LoG values, collected per band and merged
+	struct RawStatistics {
+
+		void clear();
+
+		void add(const int16_t* log, int width);
+
+		void merge(const RawStatistics& other);
+
+		std::vector <int64_t> histogram;
+		int min = 0;
+		int max = 0;
+	};
+
+	// LoG of rows [firstRow, endRow); decode is also called for the two rows around the band
+	template <typename RowDecoder, typename RowOutput>
+	void logRows(int width, int height, int firstRow, int endRow, RowDecoder decode, RowOutput output);
+
+	void findThreshold(int width, int height);
+
+	void thresholdRow(const int16_t* log, int y, uint64_t* bits);
+
+	// Contour rows of the stored LoG, in bands
+	void thresholdAll(BinaryImage* contours);
+
+	Image<int16_t> log_;
+	RawStatistics raw_;
+	int width_ = 0;
+	int height_ = 0;
+	int threshold_ = 0;
+	int rawLimit_ = 0;
+};
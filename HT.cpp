@@ -1,48 +1,180 @@
 #include "BMP.h"
+#include "BatchPipeline.h"
+#include "HoughCircleDetector.h"
 #include "Image.h"
+#include "StreamingDetector.h"
+#include "Trace.h"
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
 
-int main() {
+// Writes the recorded trace, and its summary to the error stream, when a trace file was asked for
+void finishTrace(const char* trace) {
+	if (trace == nullptr)
+		return;
+	traceStop();
+	std::cout << std::endl;
+	writeChromeTrace(trace);
+	writeTraceSummary(std::cerr);
+}
+
+int main(int argc, char** argv) {
+
+	bool gradientVoting = false;
+	const char* input = "image.bmp";
+	const char* output = "im1.bmp";
+	int bandHeight = 0;
+	const char* batch = nullptr;
+	const char* outputDirectory = nullptr;
+	int detectors = 1;
+	bool sequence = false;
+	int pyramid = 1;
+	bool pyramidRevote = true;
+	bool subPixel = false;
+	HoughEngine engine = FULL_HOUGH;
+	RadiusBand radii;
+	const char* trace = nullptr;
+	for (int i = 1; i < argc; ++i)
+		if (strcmp(argv[i], "--gradient") == 0)
+			gradientVoting = true;
+		else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+			input = argv[++i];
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+			output = argv[++i];
+		else if (strcmp(argv[i], "--no-output") == 0)
+			output = nullptr;
+		else if (strcmp(argv[i], "--band") == 0 && i + 1 < argc)
+			bandHeight = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+			batch = argv[++i];
+		else if (strcmp(argv[i], "--output-dir") == 0 && i + 1 < argc)
+			outputDirectory = argv[++i];
+		else if (strcmp(argv[i], "--detectors") == 0 && i + 1 < argc)
+			detectors = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--sequence") == 0)
+			sequence = true;
+		else if (strcmp(argv[i], "--pyramid") == 0 && i + 1 < argc)
+			pyramid = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--coarse") == 0)
+			pyramidRevote = false;
+		else if (strcmp(argv[i], "--subpixel") == 0)
+			subPixel = true;
+		else if (strcmp(argv[i], "--radii") == 0 && i + 2 < argc) {
+			radii.minRadius = atoi(argv[++i]);
+			radii.maxRadius = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--radius-tolerance") == 0 && i + 1 < argc)
+			radii.tolerance = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			trace = argv[++i];
+		else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+			++i;
+			if (strcmp(argv[i], "rht") == 0)
+				engine = RANDOMIZED_HOUGH;
+			else if (strcmp(argv[i], "auto") == 0)
+				engine = AUTO_HOUGH;
+			else
+				engine = FULL_HOUGH;
+		}
+
+	if (trace != nullptr) {
+#ifdef HT_TRACE
+		traceStart();
+#else
+		std::cerr << "--trace needs a build with HT_TRACE defined" << std::endl;
+		trace = nullptr;
+#endif
+	}
+
+	if (!pyramidRevote && pyramid <= 1)
+		std::cerr << "--coarse needs --pyramid 2 or 4 and is ignored" << std::endl;
+	else if (!pyramidRevote && gradientVoting)
+		std::cerr << "--coarse votes at the coarse resolution only, without gradient directions" << std::endl;
+
+	if (batch != nullptr) {
+		BatchOptions options;
+		options.gradientVoting = gradientVoting;
+		options.detectors = detectors;
+		options.sequence = sequence;
+		options.pyramid = pyramid;
+		options.pyramidRevote = pyramidRevote;
+		options.subPixel = subPixel;
+		options.engine = engine;
+		options.radii = radii;
+		if (outputDirectory != nullptr)
+			options.outputDirectory = outputDirectory;
+		double wallTime = 0;
+		std::vector <BatchResult> results = runBatch(batchInputs(batch), options, &wallTime);
+		printBatchReport(results, wallTime);
+		finishTrace(trace);
+		return 0;
+	}
 
 	auto tic = std::chrono::steady_clock::now();
-	Bmp* bmpImage = new Bmp("image.bmp");
-	RgbImage* rgbImage = new RgbImage(bmpImage);
-	delete bmpImage;
-	GrayImage* grayImage = new GrayImage(rgbImage);
+	MappedBmp* bmpImage = new MappedBmp(input);
+	int width = bmpImage->getWidth();
+	int height = bmpImage->getHeight();
 
-	laplacianOfGauss(grayImage);
+	// band streaming keeps memory proportional to the band height, for images that do not fit in memory
+	if (bandHeight > 0) {
+		if (pyramid > 1 || engine != FULL_HOUGH || subPixel || !pyramidRevote)
+			std::cerr << "--band searches with the dense Hough vote only; --pyramid, --coarse, --engine and --subpixel are ignored" << std::endl;
+		StreamingDetector detector(bandHeight, gradientVoting);
+		detector.radii = radii;
+		std::vector <CentersPoint> circles = detector.detect(bmpImage);
 
-	thresholdImage(grayImage);
-	inverseValues(grayImage);
-	paintBorders(grayImage);
+		auto toc = std::chrono::steady_clock::now();
+		std::chrono::steady_clock::duration period = toc - tic;
+		double time = std::chrono::duration_cast<std::chrono::nanoseconds>(period).count() / (1000.0 * 1000.0);
 
-	GrayImage* contours = new GrayImage(grayImage->getWidth(), grayImage->getHeight());
-	contours->copy(grayImage);
+		std::cout << time - detector.getSearchTime() << std::endl << detector.getSearchTime();
 
-	morphDilation(grayImage, 5);
-	morphDilation(grayImage, 5);
-	morphErosion(grayImage, 7);
-	segmentTopDownBottomUp(grayImage);
-	removeExceptCircles(grayImage);
-	grayImage->setValues();
+		if (output != nullptr)
+			writeCircles(bmpImage, circles, output, bandHeight);
+		delete bmpImage;
+		finishTrace(trace);
+
+		return 0;
+	}
+
+	HoughCircleDetector detector(gradientVoting);
+	detector.pyramid = pyramid;
+	detector.pyramidRevote = pyramidRevote;
+	detector.subPixel = subPixel;
+	detector.engine = engine;
+	detector.radii = radii;
+	std::vector <CentersPoint> circles = detector.detect(bmpImage);
 
 	auto toc = std::chrono::steady_clock::now();
 	std::chrono::steady_clock::duration period = toc - tic;
-	double time = std::chrono::duration_cast<std::chrono::nanoseconds>(period).count() / (1000.0 * 1000.0);
-
-	double timeCircle = findCircles(contours, grayImage);
-	delete contours;
+	double time = std::chrono::duration_cast<std::chrono::nanoseconds>(period).count() / (1000.0 * 1000.0) - detector.getSearchTime();
+	double timeCircle = detector.getSearchTime();
 
 	std::cout << time << std::endl << timeCircle;
-	drawCircles(rgbImage, grayImage);
-	delete grayImage;
-	Bmp* resultImage = new Bmp(rgbImage->getWidth(), rgbImage->getHeight(), false);
-	rgbToBmp(rgbImage, resultImage);
-	delete rgbImage;
 
-	resultImage->write("im1.bmp");
+	// refined circles follow the times, one "x y radius" per line
+	if (subPixel)
+		for (const RefinedCircle& circle : detector.getRefinedCircles())
+			std::cout << std::endl << circle.x << " " << circle.y << " " << circle.radius;
 
-	delete resultImage;
+	// the color image is only decoded when an annotated result is written
+	if (output != nullptr) {
+		GrayImage* grayImage = new GrayImage(width, height);
+		markCircles(*grayImage, circles);
+		RgbImage* rgbImage = new RgbImage(width, height);
+		bmpImage->toRgb(*rgbImage);
+		drawCircles(*rgbImage, *grayImage);
+		delete grayImage;
+		Bmp* resultImage = new Bmp(width, height, false);
+		rgbToBmp(*rgbImage, resultImage);
+		delete rgbImage;
+
+		resultImage->write(output);
+
+		delete resultImage;
+	}
+	delete bmpImage;
+	finishTrace(trace);
 
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,332 @@
+#include "HoughCircleDetector.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+
+HoughCircleDetector::HoughCircleDetector(bool gradientVoting, int angleTolerance) : contours_(0, 0), mask_(0, 0), coarse_(0, 0) {
+	this->gradientVoting = gradientVoting;
+	this->angleTolerance = angleTolerance;
+	morphology = { MorphOperation(DILATION, 5), MorphOperation(DILATION, 5), MorphOperation(EROSION, 7) };
+}
+
+std::vector <CentersPoint> HoughCircleDetector::detect(GrayView image) {
+	TRACE_SCOPE("HoughCircleDetector::detect");
+	auto tic = std::chrono::steady_clock::now();
+
+	frontEnd_.multiplier = thresholdMultiplier;
+	frontEnd_.run(image, &contours_);
+
+	std::chrono::steady_clock::duration period = std::chrono::steady_clock::now() - tic;
+	frontTime_ = std::chrono::duration_cast<std::chrono::nanoseconds>(period).count() / (1000.0 * 1000.0);
+	return findCandidates(image);
+}
+
+std::vector <CentersPoint> HoughCircleDetector::detect(MappedBmp* bmpImage) {
+	TRACE_SCOPE("HoughCircleDetector::detect");
+	auto tic = std::chrono::steady_clock::now();
+
+	// the gray image is only kept when the gradient directions or the sub-pixel fit need it
+	bool keepGray = gradientVoting || (subPixel && refinement.fit);
+	if (keepGray)
+		gray_.resize(bmpImage->getWidth(), bmpImage->getHeight());
+	frontEnd_.multiplier = thresholdMultiplier;
+	frontEnd_.run(bmpImage, &contours_, keepGray ? gray_.view() : GrayView());
+
+	std::chrono::steady_clock::duration period = std::chrono::steady_clock::now() - tic;
+	frontTime_ = std::chrono::duration_cast<std::chrono::nanoseconds>(period).count() / (1000.0 * 1000.0);
+	return findCandidates(keepGray ? gray_.view() : GrayView());
+}
+
+std::vector <CentersPoint> HoughCircleDetector::findCandidates(GrayView gray) {
+	auto tic = std::chrono::steady_clock::now();
+
+	int width = contours_.getWidth();
+	int height = contours_.getHeight();
+
+	mask_.resize(width, height);
+	mask_.words = contours_.words;
+	morphSequence(&mask_, morphology, &morphBuffers_);
+	labels_.resize(width, height);
+	segmentUnionFind(&mask_, labels_);
+	removeExceptCircles(labels_, segments_);
+
+	auto toc = std::chrono::steady_clock::now();
+	frontTime_ += std::chrono::duration_cast<std::chrono::nanoseconds>(toc - tic).count() / (1000.0 * 1000.0);
+
+	DirectionView directions;
+	if (gradientVoting && !gray.isEmpty()) {
+		directions_.resize(width, height);
+		directions = directions_.view();
+		gradientDirections(gray, &contours_, directions);
+	}
+	randomizedSegments_ = 0;
+	randomizedFallbacks_ = 0;
+	estimates_.clear();
+	std::vector <CentersPoint> circles;
+	if (tracking && !previous_.empty())
+		circles = trackCircles(directions);
+	else if (pyramid > 1) {
+		circles = pyramidCircles(directions);
+		if (tracking)
+			trackingStats_.fresh += (int)segments_.size();
+	}
+	else {
+		circles = fullSearch(segments_, directions);
+		if (tracking)
+			trackingStats_.fresh += (int)segments_.size();
+	}
+	if (subPixel)
+		refineCircles(circles, gray, directions);
+	else
+		refined_.clear();
+	if (tracking)
+		previous_ = circles;
+
+	std::chrono::steady_clock::duration period = std::chrono::steady_clock::now() - toc;
+	searchTime_ = std::chrono::duration_cast<std::chrono::nanoseconds>(period).count() / (1000.0 * 1000.0);
+	return circles;
+}
+
+std::vector <CentersPoint> HoughCircleDetector::trackCircles(DirectionView directions) {
+	TRACE_SCOPE("HoughCircleDetector::trackCircles");
+
+	// a previous circle is followed into the first free segment whose bounding box holds its center
+	std::vector <int> track(segments_.size(), -1);
+	for (int t = 0; t < previous_.size(); ++t) {
+		Point center = previous_[t].point;
+		bool found = false;
+		for (int i = 0; i < segments_.size() && !found; ++i) {
+			Rect box = segments_[i].getBorders();
+			if (track[i] < 0 && center.x >= box.min.x && center.x <= box.max.x && center.y >= box.min.y && center.y <= box.max.y) {
+				track[i] = t;
+				found = true;
+			}
+		}
+		if (!found)
+			++trackingStats_.lost;
+	}
+
+	std::vector <int> tracked;
+	std::vector <CentersPoint> seeds;
+	for (int i = 0; i < segments_.size(); ++i)
+		if (track[i] >= 0) {
+			tracked.push_back(i);
+			seeds.push_back(previous_[track[i]]);
+		}
+	std::vector <CentersPoint> peaks;
+	searchAround(tracked, seeds, trackingMotion, trackingRadius, directions, peaks);
+
+	std::vector <CentersPoint> circles;
+	untracked_.clear();
+	for (int i = 0; i < segments_.size(); ++i)
+		if (track[i] < 0) {
+			untracked_.push_back(segments_[i]);
+			++trackingStats_.fresh;
+		}
+	for (int n = 0; n < tracked.size(); ++n)
+		if (peaks[n].count > 0 && peaks[n].count >= trackingAcceptance * seeds[n].count) {
+			circles.push_back(peaks[n]);
+			++trackingStats_.tracked;
+		}
+		else {
+			untracked_.push_back(segments_[tracked[n]]);
+			++trackingStats_.fallbacks;
+		}
+
+	std::vector <CentersPoint> searched = fullSearch(untracked_, directions);
+	circles.insert(circles.end(), searched.begin(), searched.end());
+	return circles;
+}
+
+void HoughCircleDetector::searchAround(const std::vector <int>& indices, const std::vector <CentersPoint>& seeds, int motion,
+	int radiusBand, DirectionView directions, std::vector <CentersPoint>& peaks) {
+	TRACE_SCOPE("HoughCircleDetector::searchAround");
+
+	int width = contours_.getWidth();
+	int height = contours_.getHeight();
+
+	if (windowAccumulators_.size() < indices.size())
+		windowAccumulators_.resize(indices.size(), Accumulator(Rect(Point(0, 0), Point(0, 0)), MIN_RADIUS, MIN_RADIUS));
+
+	// the window is two pixels wider than the motion on each side: votes never land on its edge, and
+	// a peak next to the edge is rejected below, so a peak exactly motion pixels away is still accepted.
+	// The radius band is widened by one for the same reason. Both stay within what the full search of
+	// the segment covers, so the votes in the window are the same as there.
+	ThreadPool& pool = ThreadPool::shared();
+	TaskGroup group;
+	for (int n = 0; n < indices.size(); ++n) {
+		const CentersPoint& seed = seeds[n];
+		Segment& segment = segments_[indices[n]];
+		Rect borders = searchBorders(segment, width, height);
+		int segmentMin, segmentMax;
+		segmentRadii(segment, radii, &segmentMin, &segmentMax);
+		Rect window(Point(std::max(seed.point.x - motion - 2, borders.min.x), std::max(seed.point.y - motion - 2, borders.min.y)),
+			Point(std::min(seed.point.x + motion + 2, borders.max.x), std::min(seed.point.y + motion + 2, borders.max.y)));
+		int minRadius = std::max(seed.radius - radiusBand - 1, segmentMin);
+		int maxRadius = std::min(seed.radius + radiusBand + 2, segmentMax);
+		// a seed outside the segment's reach gets an empty window, and with it no peak
+		if (window.min.x >= window.max.x || window.min.y >= window.max.y || minRadius >= maxRadius) {
+			windowAccumulators_[n].reset(Rect(borders.min, borders.min), segmentMin, segmentMin);
+			continue;
+		}
+		windowAccumulators_[n].reset(window, minRadius, maxRadius);
+
+		BinaryImage* contours = &contours_;
+		Accumulator* target = &windowAccumulators_[n];
+		int tolerance = angleTolerance;
+		for (int k = minRadius; k < maxRadius; ++k)
+			pool.submit(&group, [contours, target, k, borders, directions, tolerance] {
+				centerInWindow(contours, target, k, borders, directions, tolerance);
+			});
+	}
+	pool.wait(&group);
+
+	// a peak on the edge of the window or of the radius band may belong to a circle further away, unless
+	// that edge is one of the segment's search
+	peaks.clear();
+	for (int n = 0; n < indices.size(); ++n) {
+		Accumulator& accumulator = windowAccumulators_[n];
+		Segment& segment = segments_[indices[n]];
+		Rect borders = searchBorders(segment, width, height);
+		int segmentMin, segmentMax;
+		segmentRadii(segment, radii, &segmentMin, &segmentMax);
+		Rect window = accumulator.getBorders();
+		CentersPoint best = accumulator.peak();
+		bool inside = (best.point.x > window.min.x + 1 || window.min.x == borders.min.x)
+			&& (best.point.x < window.max.x - 1 || window.max.x == borders.max.x)
+			&& (best.point.y > window.min.y + 1 || window.min.y == borders.min.y)
+			&& (best.point.y < window.max.y - 1 || window.max.y == borders.max.y)
+			&& (best.radius > accumulator.getMinRadius() || best.radius == segmentMin)
+			&& (best.radius < accumulator.getMaxRadius() - 1 || best.radius == segmentMax - 1);
+		if (!inside)
+			best.count = 0;
+		peaks.push_back(best);
+	}
+}
+
+std::vector <CentersPoint> HoughCircleDetector::pyramidCircles(DirectionView directions) {
+	TRACE_SCOPE("HoughCircleDetector::pyramidCircles");
+
+	int width = contours_.getWidth();
+	int height = contours_.getHeight();
+	int factor = pyramid;
+
+	// coarse votes on the contours shrunk by factor, with the radius band of every segment shrunk alike;
+	// they only seed the full resolution search, so they go along whole arcs even with gradient voting
+	downsample(&contours_, factor, &coarse_);
+
+	if (coarseAccumulators_.size() < segments_.size())
+		coarseAccumulators_.resize(segments_.size(), Accumulator(Rect(Point(0, 0), Point(0, 0)), MIN_RADIUS, MIN_RADIUS));
+
+	ThreadPool& pool = ThreadPool::shared();
+	TaskGroup group;
+	for (int i = 0; i < segments_.size(); ++i) {
+		Rect borders = searchBorders(segments_[i], width, height);
+		borders = Rect(Point(borders.min.x / factor, borders.min.y / factor), Point(borders.max.x / factor, borders.max.y / factor));
+		int minRadius, maxRadius;
+		segmentRadii(segments_[i], radii, &minRadius, &maxRadius);
+		int coarseMin = std::max(minRadius / factor, 1);
+		int coarseMax = (minRadius < maxRadius) ? (maxRadius - 1) / factor + 2 : coarseMin;
+		prepareStencils(coarseMin, coarseMax);
+		coarseAccumulators_[i].reset(borders, coarseMin, coarseMax);
+
+		BinaryImage* coarse = &coarse_;
+		Accumulator* target = &coarseAccumulators_[i];
+		int tolerance = angleTolerance;
+		for (int k = coarseMin; k < coarseMax; ++k)
+			pool.submit(&group, [coarse, target, k, tolerance] {
+				centerForRadius(coarse, target, k, DirectionView(), tolerance);
+			});
+	}
+	pool.wait(&group);
+
+	// every coarse peak is refined at full resolution within one coarse pixel of center and radius,
+	// or without the revote interpolated into an estimate for refineCircles
+	std::vector <int> refined;
+	std::vector <CentersPoint> seeds;
+	std::vector <CentersPoint> circles;
+	untracked_.clear();
+	for (int i = 0; i < segments_.size(); ++i) {
+		CentersPoint coarsePeak = coarseAccumulators_[i].peak();
+		if (coarsePeak.count == 0) {
+			untracked_.push_back(segments_[i]);
+			continue;
+		}
+		if (!pyramidRevote) {
+			RefinedCircle estimate = interpolatePeak(coarseAccumulators_[i], coarsePeak, factor);
+			estimates_.push_back(estimate);
+			circles.push_back(estimate.toCentersPoint(coarsePeak.count));
+			continue;
+		}
+		Point center(coarsePeak.point.x * factor + factor / 2, coarsePeak.point.y * factor + factor / 2);
+		refined.push_back(i);
+		seeds.push_back(CentersPoint(center, coarsePeak.radius * factor));
+	}
+	std::vector <CentersPoint> peaks;
+	searchAround(refined, seeds, factor, factor, directions, peaks);
+
+	for (int n = 0; n < refined.size(); ++n)
+		if (peaks[n].count > 0)
+			circles.push_back(peaks[n]);
+		else
+			untracked_.push_back(segments_[refined[n]]);
+	pyramidFallbacks_ = (int)untracked_.size();
+
+	std::vector <CentersPoint> searched = fullSearch(untracked_, directions);
+	circles.insert(circles.end(), searched.begin(), searched.end());
+	return circles;
+}
+
+void HoughCircleDetector::refineCircles(std::vector <CentersPoint>& circles, GrayView gray, DirectionView directions) {
+	TRACE_SCOPE("HoughCircleDetector::refineCircles");
+
+	refined_.resize(circles.size());
+	if (refineWindows_.size() < circles.size())
+		refineWindows_.resize(circles.size(), Accumulator(Rect(Point(0, 0), Point(0, 0)), MIN_RADIUS, MIN_RADIUS));
+
+	// the stencils are built before the tasks share them
+	for (int n = (int)estimates_.size(); n < circles.size(); ++n)
+		prepareStencils(std::max(circles[n].radius - refinement.reach, 1), circles[n].radius + refinement.reach + 1);
+
+	ThreadPool& pool = ThreadPool::shared();
+	TaskGroup group;
+	for (int n = 0; n < circles.size(); ++n)
+		pool.submit(&group, [this, &circles, n, gray, directions] {
+			RefinedCircle circle = (n < estimates_.size()) ? estimates_[n]
+				: revoteCircle(&contours_, circles[n], refinement, &refineWindows_[n], directions, angleTolerance);
+			if (refinement.fit && !gray.isEmpty())
+				fitCircle(gray, circle, refinement);
+			refined_[n] = circle;
+			circles[n] = circle.toCentersPoint(circles[n].count);
+		});
+	pool.wait(&group);
+}
+
+std::vector <CentersPoint> HoughCircleDetector::fullSearch(std::vector <Segment>& segments, DirectionView directions) {
+	TRACE_SCOPE("HoughCircleDetector::fullSearch");
+
+	if (engine == FULL_HOUGH)
+		return searchCircles(&contours_, segments, directions, angleTolerance, accumulators_, radii);
+
+	int width = contours_.getWidth();
+	int height = contours_.getHeight();
+	randomizedInput_.clear();
+	denseInput_.clear();
+	for (Segment& segment : segments)
+		if (engine == RANDOMIZED_HOUGH || contourCount(&contours_, searchBorders(segment, width, height)) >= autoEdgeCount)
+			randomizedInput_.push_back(segment);
+		else
+			denseInput_.push_back(segment);
+
+	// segments without a verified circle join the dense search
+	size_t dense = denseInput_.size();
+	std::vector <CentersPoint> circles = searchCirclesRandomized(&contours_, randomizedInput_, randomized, radii, randomizedBuffers_,
+		denseInput_);
+	randomizedSegments_ += (int)randomizedInput_.size();
+	randomizedFallbacks_ += (int)(denseInput_.size() - dense);
+
+	std::vector <CentersPoint> searched = searchCircles(&contours_, denseInput_, directions, angleTolerance, accumulators_, radii);
+	circles.insert(circles.end(), searched.begin(), searched.end());
+	return circles;
+}
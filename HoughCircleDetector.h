@@ -0,0 +1,136 @@
+#pragma once
+
+#include "BMP.h"
+#include "BinaryImage.h"
+#include "CircleRefinement.h"
+#include "FrontEnd.h"
+#include "Image.h"
+#include "RandomizedHough.h"
+#include <vector>
+
+// Search every segment with the dense Hough accumulator, with the randomized Hough transform, or pick per
+// segment: RHT for the segments with at least autoEdgeCount contour pixels, where the dense vote costs the most
+enum HoughEngine { FULL_HOUGH, RANDOMIZED_HOUGH, AUTO_HOUGH };
+
+// How the segments of a sequence were searched, counted over all frames
+struct TrackingStats {
+	int tracked = 0;   // found again close to a circle of the previous frame
+	int fallbacks = 0; // tracked search rejected, searched in full
+	int fresh = 0;     // no circle of the previous frame inside, searched in full
+	int lost = 0;      // circles of the previous frame without a segment around them
+};
+
+// The whole detection (front end, morphology, labeling, segment filter and Hough search) as one object.
+// It keeps no state outside itself: every working buffer is a member, sized by the first image and reused
+// for the following ones, so a detector per thread can run concurrently with the others.
+struct HoughCircleDetector {
+
+	HoughCircleDetector(bool gradientVoting = false, int angleTolerance = GRADIENT_TOLERANCE);
+
+	// One circle per segment that looks like one, radii in the segment's band of radii
+	std::vector <CentersPoint> detect(GrayView image);
+
+	// Decodes the bitmap as part of the front end pass; the rows are in MappedBmp order
+	std::vector <CentersPoint> detect(MappedBmp* bmpImage);
+
+	// Times of the last detect in milliseconds: everything before the Hough search, and the search
+	double getFrontTime() { return frontTime_; }
+	double getSearchTime() { return searchTime_; }
+
+	// Sequence mode: each detect starts from the circles of the previous one. A segment holding a previous
+	// center is searched only within trackingMotion pixels of it and trackingRadius of its radius, both
+	// included, voting along the stencil arcs that reach that window and, with gradient voting, only where
+	// they meet the gradient arcs. New segments, and tracked ones whose peak is weaker than
+	// trackingAcceptance of the previous votes or lies further away, get the full search.
+	void resetTracking() { previous_.clear(); }
+
+	TrackingStats getTrackingStats() { return trackingStats_; }
+
+	// Pyramid mode (pyramid 2 or 4): the Hough vote runs on the contours shrunk by that factor, with
+	// the radii shrunk alike, and every coarse peak is refined at full resolution within one coarse pixel
+	// of its center and radius, clipped to the window and band of radii the full search of the segment
+	// would use. Segments are still found at full resolution, and a refined peak on the edge of its window
+	// sends the segment to the full search, see getPyramidFallbacks. On segments of one circle the result
+	// is that of the full search; where touching circles share a segment the coarse peak may pick another
+	// of them.
+	// With gradient voting the coarse vote still goes along whole arcs, the full resolution one follows
+	// the gradients.
+	int getPyramidFallbacks() { return pyramidFallbacks_; }
+
+	// Sub-pixel mode: every detected circle is refined, see CircleRefinement.h. Circles without a coarse
+	// estimate are voted again around their peak, within refinement.reach, and the vertex of the votes is
+	// interpolated; with refinement.fit a least squares circle through the gray edge around it follows.
+	// Only the fit corrects the radius: the vote peaks about half a pixel outside the edge, and the
+	// interpolation keeps that offset. detect then returns the rounded refined circles, getRefinedCircles the refined ones in the same order.
+	// Without pyramidRevote the pyramid search skips the full resolution vote and interpolates the coarse
+	// peak directly, so the Hough vote runs at half or quarter resolution only.
+	const std::vector <RefinedCircle>& getRefinedCircles() { return refined_; }
+
+	// Segments of the last detect searched with RHT, and those of them sent to the dense search because no
+	// circle passed the verification. RHT ignores gradient directions.
+	int getRandomizedSegments() { return randomizedSegments_; }
+	int getRandomizedFallbacks() { return randomizedFallbacks_; }
+
+	bool gradientVoting;
+	int angleTolerance;
+	float thresholdMultiplier = 1.0;
+	RadiusBand radii;
+	std::vector <MorphOperation> morphology;
+	bool tracking = false;
+	int trackingMotion = 4;
+	int trackingRadius = 2;
+	float trackingAcceptance = 0.6;
+	int pyramid = 1;
+	bool pyramidRevote = true;
+	bool subPixel = false;
+	RefineOptions refinement;
+	HoughEngine engine = FULL_HOUGH;
+	int autoEdgeCount = 60;
+	RandomizedOptions randomized;
+
+private:
+	std::vector <CentersPoint> findCandidates(GrayView gray);
+
+	std::vector <CentersPoint> trackCircles(DirectionView directions);
+
+	std::vector <CentersPoint> pyramidCircles(DirectionView directions);
+
+	// Replaces circles by their refinement; the first estimates_.size() of them start from those estimates.
+	// The fit needs gray, directions are those of the search.
+	void refineCircles(std::vector <CentersPoint>& circles, GrayView gray, DirectionView directions);
+
+	// Best circle of every segment with the chosen engine
+	std::vector <CentersPoint> fullSearch(std::vector <Segment>& segments, DirectionView directions);
+
+	// Peaks of segments indices[n] searched within motion pixels and radiusBand radii of seeds[n], both
+	// included; a peak further away gets count 0. With directions the votes follow the gradients.
+	void searchAround(const std::vector <int>& indices, const std::vector <CentersPoint>& seeds, int motion, int radiusBand,
+		DirectionView directions, std::vector <CentersPoint>& peaks);
+
+	FrontEnd frontEnd_;
+	GrayImage gray_;
+	BinaryImage contours_;
+	BinaryImage mask_;
+	MorphBuffers morphBuffers_;
+	LabelImage labels_;
+	DirectionImage directions_;
+	std::vector <Segment> segments_;
+	std::vector <Accumulator> accumulators_;
+	std::vector <Accumulator> windowAccumulators_;
+	std::vector <Accumulator> coarseAccumulators_;
+	BinaryImage coarse_;
+	int pyramidFallbacks_ = 0;
+	std::vector <RefinedCircle> estimates_;
+	std::vector <RefinedCircle> refined_;
+	std::vector <Accumulator> refineWindows_;
+	std::vector <Segment> untracked_;
+	std::vector <Segment> randomizedInput_;
+	std::vector <Segment> denseInput_;
+	std::vector <RandomizedBuffers> randomizedBuffers_;
+	int randomizedSegments_ = 0;
+	int randomizedFallbacks_ = 0;
+	std::vector <CentersPoint> previous_;
+	TrackingStats trackingStats_;
+	double frontTime_ = 0;
+	double searchTime_ = 0;
+};
@@ -1,17 +1,17 @@
 #pragma once
 
 #include "Image.h"
+#include "SimdKernels.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <climits>
 #include <cmath>
 #include <vector>
-#include <atomic>
+#include <algorithm>
 #include <chrono>
 #include <iostream>
-#include <thread>
-
-int hist[DICRETE_LEVEL];
-
-std::vector <int> unique;
-std::vector <Segment> segments;
+#include <map>
+#include <mutex>
 
 bool operator == (const Point& left, const Point& right) {
 	return ((left.x == right.x) && (left.y == right.y));
@@ -49,84 +49,221 @@ void Segment::addPoint(Point newPoint) {
 	++count_;
 }
 
-void normalizeValues(GrayImage* image) {
-
-	float min = image->data[0][0];
-	float max = min;
-	int size = image->getWidth() * image->getHeight();
-
-	for (int i = 0; i < size; ++i)
-		if (image->data[0][i] < min)
-			min = image->data[0][i];
-		else if (image->data[0][i] > max)
-			max = image->data[0][i];
-
-	for (int i = 0; i < size; ++i)
-		image->data[0][i] = (int)round((((float)image->data[0][i] - min) / (max - min)) * 255.0);
+void Segment::addSegment(const Segment& other) {
+	xyMin_.x = std::min(xyMin_.x, other.xyMin_.x);
+	xyMin_.y = std::min(xyMin_.y, other.xyMin_.y);
+	xyMax_.x = std::max(xyMax_.x, other.xyMax_.x);
+	xyMax_.y = std::max(xyMax_.y, other.xyMax_.y);
+	count_ += other.count_;
 }
 
-void laplacianOfGauss(GrayImage* image) {
-
-	int width = image->getWidth();
-	int height = image->getHeight();
+void normalizeValues(GrayView image) {
+
+	// every band finds its own range, starting from the first pixel
+	const uint8_t first = image.at(0, 0);
+	uint8_t low = first;
+	uint8_t high = first;
+	std::mutex mutex;
+	parallelRows(image.getHeight(), ROW_GRAIN, [&](int firstRow, int endRow) {
+		uint8_t bandLow = first;
+		uint8_t bandHigh = first;
+		for (int j = firstRow; j < endRow; ++j)
+			byteRange(image.row(j), image.getWidth(), &bandLow, &bandHigh);
+		std::lock_guard<std::mutex> lock(mutex);
+		low = std::min(low, bandLow);
+		high = std::max(high, bandHigh);
+	});
+
+	// every value maps through a table of the present range, a flat image to zero like laplacianOfGauss
+	float min = low;
+	float max = high;
+	uint8_t table[DICRETE_LEVEL] = {};
+	if (high > low)
+		for (int v = low; v <= high; ++v)
+			table[v] = (uint8_t)round((((float)v - min) / (max - min)) * 255.0);
+
+	parallelRows(image.getHeight(), ROW_GRAIN, [&](int firstRow, int endRow) {
+		for (int j = firstRow; j < endRow; ++j) {
+			uint8_t* row = image.row(j);
+			for (int i = 0; i < image.getWidth(); ++i)
+				row[i] = table[row[i]];
+		}
+	});
+}
 
-	GrayImage* imageLoG = new GrayImage(width, height);
+// Histogram counting of whole rows. Every fourth value goes to the same of four int histograms, since
+// runs of equal values are common and this way no increment waits for the one before it. The counts
+// are added to the 64-bit histogram before they could overflow.
+struct RowCounts {
 
-	for (int j = 0; j < height; ++j)
-		for (int i = 0; i < width; ++i)
+	RowCounts(int64_t* histogram) { this->histogram = histogram; }
 
-		{
-			int temp = 0;
-			for (int jk = -2; jk < 3; ++jk)
-				for (int ik = -2; ik < 3; ++ik)
-				{
-					if (i + ik < 0 || i + ik >= width || j + jk < 0 || j + jk >= height)
-						continue;
-					temp += (image->data[0][(j + jk) * width + (i + ik)] * LOG5[2 + ik][2 + jk]);
-				}
+	void add(const uint8_t* row, int width) {
+		int i = 0;
+		for (; i + 4 <= width; i += 4) {
+			counts[0][row[i]]++;
+			counts[1][row[i + 1]]++;
+			counts[2][row[i + 2]]++;
+			counts[3][row[i + 3]]++;
+		}
+		for (; i < width; ++i)
+			counts[0][row[i]]++;
+		pending += width;
+		if (pending >= INT_MAX / 2)
+			flush();
+	}
 
-			imageLoG->data[0][j * width + i] = temp;
+	void flush() {
+		for (int v = 0; v < DICRETE_LEVEL; ++v) {
+			histogram[v] += (int64_t)counts[0][v] + counts[1][v] + counts[2][v] + counts[3][v];
+			counts[0][v] = counts[1][v] = counts[2][v] = counts[3][v] = 0;
 		}
+		pending = 0;
+	}
 
-	normalizeValues(imageLoG);
+	int64_t* histogram;
+	int counts[4][DICRETE_LEVEL] = {};
+	int64_t pending = 0;
+};
+
+// Runs the LoG kernel over rows [firstRow, endRow) of the image and hands every finished 16-bit row to
+// output. The five input rows under the kernel are kept as zero padded 16-bit rows in a ring, so neither
+// the vector loop nor the image border needs a bounds check. Bands read the two rows around them again.
+template <typename RowOutput>
+void logRows(GrayView image, int firstRow, int endRow, RowOutput output) {
+
+	int width = image.getWidth();
+	int height = image.getHeight();
+
+	int stride = width + 2 * LOG_PADDING;
+	std::vector <int16_t> ring((size_t)6 * stride, 0);
+	std::vector <int16_t> out(width);
+	const int16_t* zeroRow = ring.data() + (size_t)5 * stride + LOG_PADDING;
+
+	auto ringRow = [&](int y) { return ring.data() + (size_t)(y % 5) * stride + LOG_PADDING; };
+	auto loadRow = [&](int y) {
+		int16_t* row = ringRow(y);
+		uint8_t* src = image.row(y);
+		for (int i = 0; i < width; ++i)
+			row[i] = src[i];
+	};
 
-	image->copy(imageLoG);
-	delete imageLoG;
-}
+	for (int y = std::max(firstRow - 2, 0); y < firstRow + 2 && y < height; ++y)
+		loadRow(y);
 
-void getHistogram(GrayImage* image) {
+	for (int y = firstRow; y < endRow; ++y) {
+		if (y + 2 < height)
+			loadRow(y + 2);
 
-	int size = image->getWidth() * image->getHeight();
+		const int16_t* rows[5];
+		for (int k = 0; k < 5; ++k)
+			rows[k] = (y - 2 + k >= 0 && y - 2 + k < height) ? ringRow(y - 2 + k) : zeroRow;
+		logRow(rows, out.data(), width);
+		output(y, out.data());
+	}
+}
 
-	for (int i = 0; i < size; ++i)
-		hist[(int)image->data[0][i]]++;
+// Bands of the LoG recompute four rows each, so they are kept larger than ROW_GRAIN
+const int LOG_GRAIN = 64;
+
+void laplacianOfGauss(GrayView image, GrayView result, int64_t* histogram) {
+	TRACE_SCOPE("laplacianOfGauss");
+
+	int width = image.getWidth();
+
+	// the kernel is cheap enough to run twice: first for the value range, then writing normalized pixels,
+	// which saves a full size 16-bit intermediate image
+	int min = INT_MAX;
+	int max = INT_MIN;
+	std::mutex mutex;
+	parallelRows(image.getHeight(), LOG_GRAIN, [&](int firstRow, int endRow) {
+		int bandMin = INT_MAX;
+		int bandMax = INT_MIN;
+		logRows(image, firstRow, endRow, [&](int, const int16_t* out) {
+			for (int i = 0; i < width; ++i) {
+				bandMin = std::min(bandMin, (int)out[i]);
+				bandMax = std::max(bandMax, (int)out[i]);
+			}
+		});
+		std::lock_guard<std::mutex> lock(mutex);
+		min = std::min(min, bandMin);
+		max = std::max(max, bandMax);
+	});
+
+	// LoG values span only a few thousand levels, so normalization is a table lookup
+	// computed with the same rounding as normalizeValues
+	std::vector <uint8_t> table(max - min + 1, 0);
+	if (max > min)
+		for (int v = min; v <= max; ++v)
+			table[v - min] = (uint8_t)round(((float)v - (float)min) / ((float)max - (float)min) * 255.0);
+
+	if (histogram != nullptr)
+		std::fill(histogram, histogram + DICRETE_LEVEL, 0);
+	parallelRows(image.getHeight(), LOG_GRAIN, [&](int firstRow, int endRow) {
+		int64_t bandHistogram[DICRETE_LEVEL] = {};
+		RowCounts counts(bandHistogram);
+		logRows(image, firstRow, endRow, [&](int y, const int16_t* out) {
+			uint8_t* dst = result.row(y);
+			for (int i = 0; i < width; ++i)
+				dst[i] = table[out[i] - min];
+			if (histogram != nullptr)
+				counts.add(dst, width);
+		});
+		if (histogram == nullptr)
+			return;
+		counts.flush();
+		std::lock_guard<std::mutex> lock(mutex);
+		for (int v = 0; v < DICRETE_LEVEL; ++v)
+			histogram[v] += bandHistogram[v];
+	});
 }
 
-int sumValues(GrayImage* image) {
+void laplacianOfGauss(GrayView image) {
 
-	int sum = 0;
-	int size = image->getWidth() * image->getHeight();
+	GrayImage* imageLoG = new GrayImage(image.getWidth(), image.getHeight());
+	laplacianOfGauss(image, *imageLoG);
 
-	for (int i = 0; i < size; ++i)
-		sum += (int)image->data[0][i];
+	image.copy(*imageLoG);
+	delete imageLoG;
+}
 
-	return sum;
+void getHistogram(GrayView image, int64_t* histogram) {
+	TRACE_SCOPE("getHistogram");
+
+	// every band counts into its own histogram and adds it to the result when done
+	std::fill(histogram, histogram + DICRETE_LEVEL, 0);
+	std::mutex mutex;
+	parallelRows(image.getHeight(), ROW_GRAIN, [&](int firstRow, int endRow) {
+		int64_t bandHistogram[DICRETE_LEVEL] = {};
+		RowCounts counts(bandHistogram);
+		for (int j = firstRow; j < endRow; ++j)
+			counts.add(image.row(j), image.getWidth());
+		counts.flush();
+		std::lock_guard<std::mutex> lock(mutex);
+		for (int v = 0; v < DICRETE_LEVEL; ++v)
+			histogram[v] += bandHistogram[v];
+	});
 }
 
-int threshold_Otsu(GrayImage* image) {
+int threshold_Otsu(const int64_t* histogram) {
 
-	int all_pixel_count = image->getWidth() * image->getHeight();
-	int all_intensity_sum = sumValues(image);
+	// pixel count and intensity sum follow from the histogram
+	int64_t all_pixel_count = 0;
+	int64_t all_intensity_sum = 0;
+	for (int v = 0; v < DICRETE_LEVEL; ++v) {
+		all_pixel_count += histogram[v];
+		all_intensity_sum += (int64_t)v * histogram[v];
+	}
 
 	int best_thresh = 0;
 	double best_sigma = 0.0;
 
-	int first_class_pixel_count = 0;
-	int first_class_intensity_sum = 0;
+	int64_t first_class_pixel_count = 0;
+	int64_t first_class_intensity_sum = 0;
 
 	for (int thresh = 0; thresh < DICRETE_LEVEL - 1; ++thresh) {
-		first_class_pixel_count += hist[thresh];
-		first_class_intensity_sum += thresh * hist[thresh];
+		first_class_pixel_count += histogram[thresh];
+		first_class_intensity_sum += (int64_t)thresh * histogram[thresh];
 
 		double first_class_prob = first_class_pixel_count / (double)all_pixel_count;
 		double second_class_prob = 1.0 - first_class_prob;
@@ -148,408 +285,565 @@ int threshold_Otsu(GrayImage* image) {
 	return best_thresh;
 }
 
-void binarize(GrayImage* image, int threshold) {
+int threshold_Otsu(GrayView image) {
 
-	int size = image->getWidth() * image->getHeight();
-	for (int i = 0; i < size; ++i)
-		if (image->data[0][i] >= threshold)
-			image->data[0][i] = 255;
-		else
-			image->data[0][i] = 0;
+	int64_t histogram[DICRETE_LEVEL];
+	getHistogram(image, histogram);
+	return threshold_Otsu(histogram);
 }
 
-void thresholdImage(GrayImage* image, float multiplier) {
+void binarize(GrayView image, int threshold) {
 
-	getHistogram(image);
-	int thresh = threshold_Otsu(image);
-	binarize(image, (int)(multiplier * thresh));
+	parallelRows(image.getHeight(), ROW_GRAIN, [&](int firstRow, int endRow) {
+		for (int j = firstRow; j < endRow; ++j)
+			thresholdBytes(image.row(j), image.getWidth(), threshold, false);
+	});
 }
 
-void inverseValues(GrayImage* image) {
+void thresholdImage(GrayView image, float multiplier, const int64_t* histogram) {
+	TRACE_SCOPE("thresholdImage");
+
+	int thresh = (histogram != nullptr) ? threshold_Otsu(histogram) : threshold_Otsu(image);
+	binarize(image, (int)(multiplier * thresh));
+}
 
-	int size = image->getWidth() * image->getHeight();
+void inverseValues(GrayView image) {
 
-	for (int i = 0; i < size; ++i)
-		image->data[0][i] = (image->data[0][i] > 0) ? 0 : 255;
+	parallelRows(image.getHeight(), ROW_GRAIN, [&](int firstRow, int endRow) {
+		for (int j = firstRow; j < endRow; ++j)
+			thresholdBytes(image.row(j), image.getWidth(), 1, true);
+	});
 }
 
-void paintBorders(GrayImage* image, int width) {
-	for (int i = 0; i < image->getWidth(); ++i)
+void paintBorders(GrayView image, int width) {
+	for (int i = 0; i < image.getWidth(); ++i)
 		for (int j = 0; j < width; ++j)
 		{
-			image->data[j][i] = 0;
-			image->data[image->getHeight() - j - 1][i] = 0;
+			image.row(j)[i] = 0;
+			image.row(image.getHeight() - j - 1)[i] = 0;
 		}
 
-	for (int j = 0; j < image->getHeight(); ++j)
+	for (int j = 0; j < image.getHeight(); ++j)
 		for (int i = 0; i < width; ++i)
 		{
-			image->data[j][i] = 0;
-			image->data[j][image->getWidth() - i - 1] = 0;
+			image.row(j)[i] = 0;
+			image.row(j)[image.getWidth() - i - 1] = 0;
 		}
 
 }
 
-void morphDilation(GrayImage* image, int size) {
-	int spc = (size % 2 == 1) ? ((size - 1) / 2) : (size / 2); //spacing
+// Extremum of every window [k - before, k + after] of a line, after van Herk / Gil-Werman: the line is cut
+// into blocks of the window length, and each window is the union of a block suffix and the next block prefix.
+void runningExtremum(int* line, int length, int before, int after, bool maximum, int neutral,
+	std::vector <int>& prefix, std::vector <int>& suffix) {
 
-	GrayImage* dilated = new GrayImage(image->getWidth(), image->getHeight());
-	dilated->copy(image);
+	int window = before + after + 1;
+	int padded = (length + window - 1 + window - 1) / window * window;
+	prefix.resize(padded);
+	suffix.resize(padded);
 
-	for (int i = spc; i < image->getWidth() - spc; ++i)
-		for (int j = spc; j < image->getHeight() - spc; ++j) {
-			if (image->data[j][i] > 0)
-				for (int di = -spc; di < spc; ++di)
-					for (int dj = -spc; dj < spc; ++dj)
-						dilated->data[j + dj][i + di] = 255;
-		}
-	image->copy(dilated);
-	delete dilated;
-}
+	for (int k = 0; k < padded; ++k) {
+		int x = k - before;
+		prefix[k] = suffix[k] = (x >= 0 && x < length) ? line[x] : neutral;
+	}
 
-void morphErosion(GrayImage* image, int size) {
-	int spc = (size % 2 == 1) ? ((size - 1) / 2) : (size / 2); //spacing
+	for (int start = 0; start < padded; start += window)
+		for (int k = start + 1; k < start + window; ++k) {
+			prefix[k] = maximum ? std::max(prefix[k], prefix[k - 1]) : std::min(prefix[k], prefix[k - 1]);
+			int m = 2 * start + window - 1 - k;
+			suffix[m] = maximum ? std::max(suffix[m], suffix[m + 1]) : std::min(suffix[m], suffix[m + 1]);
+		}
 
-	GrayImage* eroded = new GrayImage(image->getWidth(), image->getHeight());
-	eroded->copy(image);
+	for (int k = 0; k < length; ++k)
+		line[k] = maximum ? std::max(suffix[k], prefix[k + window - 1]) : std::min(suffix[k], prefix[k + window - 1]);
+}
 
-	for (int i = spc; i < image->getWidth() - spc; ++i)
-		for (int j = spc; j < image->getHeight() - spc; ++j) {
-			if (image->data[j][i] == 0)
-				for (int di = -spc; di < spc; ++di)
-					for (int dj = -spc; dj < spc; ++dj)
-						eroded->data[j + dj][i + di] = 0;
+void morphSequence(GrayView image, const std::vector <MorphOperation>& operations) {
+	TRACE_SCOPE("morphSequence");
+
+	int width = image.getWidth();
+	int height = image.getHeight();
+
+	Image <int> rows(width, height);
+	std::vector <int> column(height);
+	std::vector <int> prefix;
+	std::vector <int> suffix;
+
+	for (const MorphOperation& operation : operations) {
+		int spc = (operation.size % 2 == 1) ? ((operation.size - 1) / 2) : (operation.size / 2); //spacing
+		bool maximum = (operation.type == DILATION);
+		int neutral = maximum ? 0 : 255;
+		if (spc < 1)
+			continue;
+
+		// only pixels at least spc away from the image border spread to the window [p - spc + 1, p + spc]
+		for (int j = 0; j < height; ++j) {
+			int* line = rows.row(j);
+			uint8_t* src = image.row(j);
+			for (int i = 0; i < width; ++i)
+				line[i] = (j >= spc && j < height - spc && i >= spc && i < width - spc) ? src[i] : neutral;
+			runningExtremum(line, width, spc - 1, spc, maximum, neutral, prefix, suffix);
 		}
-	image->copy(eroded);
-	delete eroded;
-}
-
-bool topDown(GrayImage* image) {
-	bool isChanged = false;
-	for (int i = 1; i < image->getWidth() - 1; ++i)
-		for (int j = 1; j < image->getHeight() - 1; ++j)
-			if (image->data[j][i] > 0) {
-				int min = image->data[j][i];
-				for (int di = -1; di <= 1; ++di)
-					for (int dj = -1; dj <= 1; ++dj)
-						if (image->data[j + dj][i + di] != 0 && image->data[j + dj][i + di] < min)
-							min = image->data[j + dj][i + di];
-				if (!isChanged)
-					if (min != image->data[j][i])
-						isChanged = true;
-				image->data[j][i] = min;
-			}
-	return isChanged;
-}
-
-bool bottomUp(GrayImage* image) {
-	bool isChanged = false;
-	for (int i = image->getWidth() - 2; i > 0; --i)
-		for (int j = image->getHeight() - 2; j > 0; --j)
-			if (image->data[j][i] > 0) {
-				int min = image->data[j][i];
-				for (int di = -1; di <= 1; ++di)
-					for (int dj = -1; dj <= 1; ++dj)
-						if (image->data[j + dj][i + di] != 0 && image->data[j + dj][i + di] < min)
-							min = image->data[j + dj][i + di];
-				if (!isChanged)
-					if (min != image->data[j][i])
-						isChanged = true;
-				image->data[j][i] = min;
+
+		for (int i = 0; i < width; ++i) {
+			for (int j = 0; j < height; ++j)
+				column[j] = rows.row(j)[i];
+			runningExtremum(column.data(), height, spc - 1, spc, maximum, neutral, prefix, suffix);
+			for (int j = 0; j < height; ++j) {
+				uint8_t& pixel = image.row(j)[i];
+				pixel = (uint8_t)(maximum ? std::max((int)pixel, column[j]) : std::min((int)pixel, column[j]));
 			}
-	return isChanged;
+		}
+	}
 }
 
-void uniqueValues(GrayImage* image) {
+void morphDilation(GrayView image, int size) {
+	morphSequence(image, { MorphOperation(DILATION, size) });
+}
 
-	unique.push_back(0);
-	for (int i = 0; i < image->getWidth(); ++i)
-		for (int j = 0; j < image->getHeight(); ++j) {
-			bool isFound = false;
-			for (int k = 0; k < unique.size(); ++k)
-				if (image->data[j][i] == unique[k])
-					isFound = true;
-			if (!isFound)
-				unique.push_back(image->data[j][i]);
-		}
+void morphErosion(GrayView image, int size) {
+	morphSequence(image, { MorphOperation(EROSION, size) });
+}
 
+int findRoot(std::vector <int>& parent, int label) {
+	while (parent[label] != label) {
+		parent[label] = parent[parent[label]];
+		label = parent[label];
+	}
+	return label;
 }
 
-void relabeling(GrayImage* image) {
+int unite(std::vector <int>& parent, int first, int second) {
+	first = findRoot(parent, first);
+	second = findRoot(parent, second);
+	if (first < second)
+		parent[second] = first;
+	else if (second < first)
+		parent[first] = second;
+	return std::min(first, second);
+}
+
+// Gives the foreground pixel (i, j) a provisional label from its already visited 8-neighbours,
+// recording equivalences in the union-find forest.
+void labelPixel(LabelView labels, std::vector <int>& parent, int i, int j) {
+
+	int width = labels.getWidth();
+	int32_t* row = labels.row(j);
+	int32_t* above = (j > 0) ? labels.row(j - 1) : nullptr;
+
+	int w = (i > 0) ? row[i - 1] : 0;
+	int nw = (i > 0 && j > 0) ? above[i - 1] : 0;
+	int n = (j > 0) ? above[i] : 0;
+	int ne = (j > 0 && i < width - 1) ? above[i + 1] : 0;
+
+	int label;
+	if (n != 0)
+		label = n;
+	else if (ne != 0) {
+		label = ne;
+		if (w != 0)
+			label = unite(parent, ne, w);
+		else if (nw != 0)
+			label = unite(parent, ne, nw);
+	}
+	else if (nw != 0)
+		label = nw;
+	else if (w != 0)
+		label = w;
+	else {
+		label = (int)parent.size();
+		parent.push_back(label);
+	}
+	row[i] = label;
+}
 
-	int n = unique.size();
-	int size = image->getWidth() * image->getHeight();
+// Second pass: roots get consecutive numbers starting from 1, and every provisional label is replaced
+// by the number of its root.
+int resolveLabels(LabelView labels, std::vector <int>& parent) {
 
-	for (int i = 0; i < size; ++i)
-		for (int k = 1; k < n; ++k)
-			if (image->data[0][i] == unique[k]) {
-				image->data[0][i] = k;
-				break;
-			}
+	std::vector <int> final(parent.size(), 0);
+	int count = 0;
+	for (int k = 1; k < parent.size(); ++k)
+		if (parent[k] == k)
+			final[k] = ++count;
+		else
+			final[k] = final[findRoot(parent, k)];
+
+	for (int j = 0; j < labels.getHeight(); ++j) {
+		int32_t* row = labels.row(j);
+		for (int i = 0; i < labels.getWidth(); ++i)
+			row[i] = final[row[i]];
+	}
+
+	return count;
 }
 
-void segmentTopDownBottomUp(GrayImage* image) {
-	int  k = 1;
-	int size = image->getWidth() * image->getHeight();
-	for (int i = 0; i < size; ++i)
-		image->data[0][i] = (image->data[0][i] > 0 ? k++ : 0);
+int segmentUnionFind(LabelView image) {
+
+	std::vector <int> parent(1, 0);
 
-	bool isChanged;
-	do {
-		isChanged = topDown(image) | bottomUp(image);
-	} while (isChanged);
+	for (int j = 0; j < image.getHeight(); ++j)
+		for (int i = 0; i < image.getWidth(); ++i)
+			if (image.row(j)[i] != 0)
+				labelPixel(image, parent, i, j);
 
-	uniqueValues(image);
-	relabeling(image);
-	unique.clear();
+	return resolveLabels(image, parent);
 }
 
-void findSegments(GrayImage* image) {
-	for (int i = 0; i < image->getWidth(); ++i)
-		for (int j = 0; j < image->getHeight(); ++j)
-			if (image->data[j][i] != 0)
-			{
-				if (segments.size() > 0)
-				{
-					bool isFound = false;
-					int segInd = 0;
-					for (int k = 0; k < segments.size(); ++k)
-						if (segments[k].getIndex() == image->data[j][i]) {
-							isFound = true;
-							segInd = k;
-							break;
-						}
-					if (isFound)
-						segments[segInd].addPoint(Point(i, j));
-					else {
-						segments.push_back(Segment(Point(i, j), image->data[j][i]));
-					}
-				}
-				else {
-					segments.push_back(Segment(Point(i, j), image->data[j][i]));
-				}
+int segmentUnionFind(BinaryImage* mask, LabelView labels) {
+	TRACE_SCOPE("segmentUnionFind");
 
-			}
+	std::vector <int> parent(1, 0);
+	labels.fill(0);
+
+	// only set bits are visited, empty words are skipped 64 pixels at a time
+	for (int j = 0; j < mask->getHeight(); ++j) {
+		uint64_t* row = mask->row(j);
+		for (int w = 0; w < mask->getWordsPerRow(); ++w)
+			for (uint64_t bits = row[w]; bits != 0; bits &= bits - 1)
+				labelPixel(labels, parent, w * 64 + lowestBit(bits), j);
+	}
+
+	int count = resolveLabels(labels, parent);
+	TRACE_COUNTER("provisional labels", parent.size() - 1);
+	TRACE_COUNTER("labels", count);
+	return count;
 }
 
-void removeSegmentByIndex(GrayImage* image, int index) {
+void findSegments(LabelView image, std::vector <Segment>& segments) {
+	TRACE_SCOPE("findSegments");
+
+	// label -> position in segments, -1 until the label is met for the first time
+	std::vector <int> slot;
+	segments.clear();
 
-	int size = image->getWidth() * image->getHeight();
+	for (int j = 0; j < image.getHeight(); ++j)
+		for (int i = 0; i < image.getWidth(); ++i)
+		{
+			int label = image.row(j)[i];
+			if (label == 0)
+				continue;
+			if (label >= slot.size())
+				slot.resize(label + 1, -1);
+			if (slot[label] < 0) {
+				slot[label] = (int)segments.size();
+				segments.push_back(Segment(Point(i, j), label));
+			}
+			else
+				segments[slot[label]].addPoint(Point(i, j));
+		}
+}
 
-	for (int i = 0; i < size; ++i)
-		if (image->data[0][i] == index)
-			image->data[0][i] = 0;
+bool isCircleCandidate(Segment& segment, int64_t imageSize, float sizeMultiplier, float maxDistortion, int pointsLimit) {
+	if (segment.getArea() > (sizeMultiplier * (double)imageSize))
+		return false;
+	if (segment.howMuch() < pointsLimit)
+		return false;
+	if (abs(segment.getDistortion()) > maxDistortion)
+		return false;
+	return true;
 }
 
-void eraseSegments(GrayImage* image, float sizeMultiplier = 0.4, float maxDistortion = 0.4, int pointsLimit = 50) {
+void eraseSegments(LabelView image, std::vector <Segment>& segments, float sizeMultiplier = 0.4, float maxDistortion = 0.4, int pointsLimit = 50) {
+	TRACE_SCOPE("eraseSegments");
 
-	int size = image->getWidth() * image->getHeight();
+	int64_t size = (int64_t)image.getWidth() * image.getHeight();
 
+	int maxLabel = 0;
+	for (int i = 0; i < segments.size(); ++i)
+		maxLabel = std::max(maxLabel, segments[i].getIndex());
+
+	std::vector <uint8_t> keep(maxLabel + 1, 0);
+	int kept = 0;
 	for (int i = 0; i < segments.size(); ++i)
 	{
-		if (segments[i].getArea() > (sizeMultiplier * size)) {
-			removeSegmentByIndex(image, segments[i].getIndex());
-			segments.erase(segments.begin() + i);
-			--i;
-		}
+		if (!isCircleCandidate(segments[i], size, sizeMultiplier, maxDistortion, pointsLimit))
+			continue;
+		keep[segments[i].getIndex()] = 1;
+		segments[kept++] = segments[i];
+	}
+	TRACE_COUNTER("segments dropped", segments.size() - kept);
+	segments.erase(segments.begin() + kept, segments.end());
+
+	// rejected labels are cleared and kept ones normalized to 255 in the same pass
+	for (int j = 0; j < image.getHeight(); ++j) {
+		int32_t* row = image.row(j);
+		for (int i = 0; i < image.getWidth(); ++i)
+			row[i] = keep[row[i]] ? 255 : 0;
+	}
+}
 
-		else if (segments[i].howMuch() < pointsLimit) {
-			removeSegmentByIndex(image, segments[i].getIndex());
-			segments.erase(segments.begin() + i);
-			--i;
-		}
+void removeExceptCircles(LabelView image, std::vector <Segment>& segments) {
+	findSegments(image, segments);
+	eraseSegments(image, segments);
+}
 
-		else if (abs(segments[i].getDistortion()) > maxDistortion) {
-			removeSegmentByIndex(image, segments[i].getIndex());
-			segments.erase(segments.begin() + i);
-			--i;
-		}
+#pragma region filter multithreaded
 
-	}
+Accumulator::Accumulator(Rect borders, int minRadius, int maxRadius) : borders_(borders) {
+	reset(borders, minRadius, maxRadius);
+}
 
+void Accumulator::reset(Rect borders, int minRadius, int maxRadius) {
+	this->borders_ = borders;
+	this->minRadius_ = minRadius;
+	this->maxRadius_ = maxRadius;
+	this->width_ = borders.max.x - borders.min.x + 1;
+	this->height_ = borders.max.y - borders.min.y + 1;
+	votes_.assign((size_t)(maxRadius - minRadius) * width_ * height_, 0);
 }
 
-void binaryNormalize(GrayImage* image) {
+CentersPoint Accumulator::peak() {
 
-	int size = image->getWidth() * image->getHeight();
+	CentersPoint best(Point(0, 0), minRadius_);
+	best.count = 0;
 
-	for (int i = 0; i < size; ++i)
-		if (image->data[0][i] >= 1)
-			image->data[0][i] = 255;
+	size_t planeSize = (size_t)width_ * height_;
+	for (int r = minRadius_; r < maxRadius_; ++r) {
+		uint16_t* votes = plane(r);
+		for (size_t i = 0; i < planeSize; ++i)
+			if (votes[i] > best.count) {
+				best.count = votes[i];
+				best.radius = r;
+				best.point = Point(borders_.min.x + (int)(i % width_), borders_.min.y + (int)(i / width_));
+			}
+	}
+	return best;
 }
 
-void removeExceptCircles(GrayImage* image) {
-	findSegments(image);
-	eraseSegments(image);
-	binaryNormalize(image);
+CircleStencil::CircleStencil(int radius) {
+	this->radius_ = radius;
+
+	// sample densely enough that no pixel of the circle is skipped, then drop repeated pixels
+	int steps = std::max(360, 8 * radius);
+	int degree = 0;
+	for (int k = 0; k < steps; ++k) {
+		double alpha = 2.0 * PI * k / steps;
+		Point offset((int)round(radius * cos(alpha)), (int)round(radius * sin(alpha)));
+		if (offsets.empty() || !(offsets.back() == offset))
+			offsets.push_back(offset);
+		for (; degree < 360 && degree * steps <= k * 360; ++degree)
+			firstAtDegree_[degree] = (int)offsets.size() - 1;
+	}
+	while (offsets.size() > 1 && offsets.back() == offsets.front())
+		offsets.pop_back();
+	for (int d = 0; d < 360; ++d)
+		if (firstAtDegree_[d] >= offsets.size())
+			firstAtDegree_[d] = 0;
 }
 
-#pragma region filter multithreaded
+std::mutex stencilsMutex;
+std::map <int, CircleStencil> stencils;
 
-std::atomic<bool> start = false;
-
-//CentersPoint centerForRadius(GrayImage* image, Rect borders, int radius) {
-//
-//	while (!start) std::this_thread::yield();
-//
-//	std::vector <CentersPoint> circle;
-//
-//	for (int x0 = borders.min.x; x0 < borders.max.x; ++x0)
-//		for (int y0 = borders.min.y; y0 < borders.max.y; ++y0)
-//			if (image->data[y0][x0] > 0)
-//				for (int alpha = 0; alpha < 360; ++alpha) {
-//					int x = (int)round((float)x0 + radius * cos(alpha * PI / 180));
-//					int y = (int)round((float)y0 + radius * sin(alpha * PI / 180));
-//					Point temp(x, y);
-//					if (x > borders.min.x && x < borders.max.x && y > borders.min.y && y < borders.max.y)
-//						if (!circle.empty()) {
-//							bool isFound = false;
-//							if (circle[circle.size() - 1].point == temp || circle[0].point == temp)
-//								continue;
-//							for (int m = 0; m < circle.size(); ++m)
-//								if (circle[m].point == temp) {
-//									isFound = true;
-//									circle[m].count++;
-//									break;
-//								}
-//							if (!isFound)
-//								circle.push_back(CentersPoint(Point(x, y), radius));
-//						}
-//						else
-//							circle.push_back(CentersPoint(Point(x, y), radius));
-//
-//				}
-//
-//	int index = 0;
-//	int max = circle[0].count;
-//
-//	for (int k = 1; k < circle.size(); ++k)
-//		if (circle[k].count > max) {
-//			max = circle[k].count;
-//			index = k;
-//		}
-//
-//	CentersPoint out(circle[index].point, circle[index].radius);
-//	out.count = circle[index].count;
-//	circle.clear();
-//
-//	return out;
-//}
-
-void centerForRadius(GrayImage* image, Rect borders, int radius, std::vector <CentersPoint>* point) {
-
-	while (!start) std::this_thread::yield();
-
-	std::vector <CentersPoint> circle;
-
-	int dAlpha = (int)floor(180.0 / (PI * (float)radius)) - 1;
-	if (dAlpha < 1) dAlpha = 1;
-
-	for (int x0 = borders.min.x; x0 < borders.max.x; ++x0)
-		for (int y0 = borders.min.y; y0 < borders.max.y; ++y0)
-			if (image->data[y0][x0] > 0)
-				for (int alpha = 0; alpha < 360; alpha += dAlpha) {
-					int x = (int)round((float)x0 + radius * cos(alpha * PI / 180));
-					int y = (int)round((float)y0 + radius * sin(alpha * PI / 180));
-					Point temp(x, y);
-					if (x > borders.min.x && x < borders.max.x && y > borders.min.y && y < borders.max.y)
-						if (!circle.empty()) {
-							bool isFound = false;
-							if (circle[circle.size() - 1].point == temp || circle[0].point == temp)
-								continue;
-							for (int m = 0; m < circle.size(); ++m)
-								if (circle[m].point == temp) {
-									isFound = true;
-									circle[m].count++;
-									break;
-								}
-							if (!isFound)
-								circle.push_back(CentersPoint(Point(x, y), radius));
-						}
-						else
-							circle.push_back(CentersPoint(Point(x, y), radius));
+const CircleStencil& circleStencil(int radius) {
+	std::lock_guard<std::mutex> lock(stencilsMutex);
+	auto found = stencils.find(radius);
+	if (found == stencils.end())
+		found = stencils.emplace(radius, CircleStencil(radius)).first;
+	return found->second;
+}
 
-				}
+void prepareStencils(int minRadius, int maxRadius) {
+	for (int r = minRadius; r < maxRadius; ++r)
+		circleStencil(r);
+}
 
-	int index = 0;
-	int max = circle[0].count;
+void gradientDirectionsRow(const uint8_t* up, const uint8_t* mid, const uint8_t* down, const uint64_t* contours,
+	int width, int16_t* directions) {
 
-	for (int k = 1; k < circle.size(); ++k)
-		if (circle[k].count > max) {
-			max = circle[k].count;
-			index = k;
+	for (int i = 0; i < width; ++i)
+		directions[i] = NO_DIRECTION;
+
+	for (int i = 1; i < width - 1; ++i)
+		if ((contours[i >> 6] >> (i & 63)) & 1) {
+			int gx = (up[i + 1] + 2 * mid[i + 1] + down[i + 1]) - (up[i - 1] + 2 * mid[i - 1] + down[i - 1]);
+			int gy = (down[i - 1] + 2 * down[i] + down[i + 1]) - (up[i - 1] + 2 * up[i] + up[i + 1]);
+			if (gx == 0 && gy == 0)
+				continue;
+			int degree = (int)round(atan2((double)gy, (double)gx) * 180.0 / PI);
+			directions[i] = (int16_t)((degree + 360) % 360);
 		}
+}
 
-	CentersPoint out(circle[index].point, circle[index].radius);
-	out.count = circle[index].count;
-	circle.clear();
+void gradientDirections(GrayView gray, BinaryImage* contours, DirectionView directions) {
+	TRACE_SCOPE("gradientDirections");
 
-	point->push_back(out);
+	int width = gray.getWidth();
+	int height = gray.getHeight();
+	directions.fill(NO_DIRECTION);
+
+	for (int j = 1; j < height - 1; ++j)
+		gradientDirectionsRow(gray.row(j - 1), gray.row(j), gray.row(j + 1), contours->row(j), width, directions.row(j));
 }
 
-double findCircles(GrayImage* image, GrayImage* circles) {
-	auto tic = std::chrono::steady_clock::now();
+// Returns the number of stencil offsets walked, the votes cast including those outside the borders
+int voteStencilRange(Accumulator* accumulator, const CircleStencil& stencil, int x0, int y0, int first, int last) {
+
+	Rect borders = accumulator->getBorders();
+	int radius = stencil.getRadius();
+	int size = (int)stencil.offsets.size();
+
+	for (int n = first;; ++n) {
+		if (n == size)
+			n = 0;
+		int x = x0 + stencil.offsets[n].x;
+		int y = y0 + stencil.offsets[n].y;
+		if (x > borders.min.x && x < borders.max.x && y > borders.min.y && y < borders.max.y)
+			accumulator->increment(x, y, radius);
+		if (n == last)
+			break;
+	}
+	return (last - first + size) % size + 1;
+}
+
+void centerForRadius(BinaryImage* contours, Accumulator* accumulator, int radius, DirectionView directions, int angleTolerance) {
+	TRACE_SCOPE("centerForRadius");
+
+	Rect borders = accumulator->getBorders();
+	const CircleStencil& stencil = circleStencil(radius);
+	int size = (int)stencil.offsets.size();
+	int64_t votes = 0;
+
+	for (int y0 = borders.min.y; y0 < borders.max.y; ++y0)
+		for (int x0 = borders.min.x; x0 < borders.max.x; ++x0)
+			if (contours->get(x0, y0)) {
+				int direction = directions.isEmpty() ? NO_DIRECTION : directions.row(y0)[x0];
+				if (direction == NO_DIRECTION) {
+					votes += voteStencilRange(accumulator, stencil, x0, y0, 0, size - 1);
+					continue;
+				}
+				// the center lies on the gradient line, on whichever side the object is
+				votes += voteStencilRange(accumulator, stencil, x0, y0,
+					stencil.atDegree(direction - angleTolerance), stencil.atDegree(direction + angleTolerance));
+				votes += voteStencilRange(accumulator, stencil, x0, y0,
+					stencil.atDegree(direction + 180 - angleTolerance), stencil.atDegree(direction + 180 + angleTolerance));
+			}
+	TRACE_COUNTER("votes", votes);
+}
+
+void centerInWindow(BinaryImage* contours, Accumulator* accumulator, int radius, Rect voters, DirectionView directions,
+	int angleTolerance) {
+	TRACE_SCOPE("centerInWindow");
+
+	Rect borders = accumulator->getBorders();
+	const CircleStencil& stencil = circleStencil(radius);
+	int size = (int)stencil.offsets.size();
+
+	// every center inside the window is within reach of its middle, so a voter only walks the arc
+	// of the stencil pointing at the window, widened by a degree for the rounding of the offsets
+	double middleX = (borders.min.x + borders.max.x) / 2.0;
+	double middleY = (borders.min.y + borders.max.y) / 2.0;
+	double reach = std::max(borders.max.x - borders.min.x, borders.max.y - borders.min.y) / 2.0 * sqrt(2.0) + 1.0;
+	int64_t votes = 0;
+
+	for (int y0 = std::max(voters.min.y, 0); y0 < std::min(voters.max.y, contours->getHeight() - 1); ++y0)
+		for (int x0 = std::max(voters.min.x, 0); x0 < std::min(voters.max.x, contours->getWidth() - 1); ++x0)
+			if (contours->get(x0, y0)) {
+				double distance = sqrt((middleX - x0) * (middleX - x0) + (middleY - y0) * (middleY - y0));
+				if (distance + reach < radius || distance - reach > radius)
+					continue;
+				int direction = directions.isEmpty() ? NO_DIRECTION : directions.row(y0)[x0];
+				if (distance <= reach) {
+					if (direction == NO_DIRECTION)
+						votes += voteStencilRange(accumulator, stencil, x0, y0, 0, size - 1);
+					else {
+						votes += voteStencilRange(accumulator, stencil, x0, y0,
+							stencil.atDegree(direction - angleTolerance), stencil.atDegree(direction + angleTolerance));
+						votes += voteStencilRange(accumulator, stencil, x0, y0,
+							stencil.atDegree(direction + 180 - angleTolerance), stencil.atDegree(direction + 180 + angleTolerance));
+					}
+					continue;
+				}
+				int degree = (int)round(atan2(middleY - y0, middleX - x0) * 180.0 / PI);
+				int spread = (int)ceil(asin(reach / distance) * 180.0 / PI) + 1;
+				if (direction == NO_DIRECTION) {
+					votes += voteStencilRange(accumulator, stencil, x0, y0, stencil.atDegree(degree - spread), stencil.atDegree(degree + spread));
+					continue;
+				}
+				// only the part of each gradient arc that also points at the window
+				for (int side = 0; side < 360; side += 180) {
+					int middle = direction + side;
+					int toWindow = ((degree - middle) % 360 + 540) % 360 - 180;
+					int first = std::max(middle - angleTolerance, middle + toWindow - spread);
+					int last = std::min(middle + angleTolerance, middle + toWindow + spread);
+					if (first <= last)
+						votes += voteStencilRange(accumulator, stencil, x0, y0, stencil.atDegree(first), stencil.atDegree(last));
+				}
+			}
+	TRACE_COUNTER("votes", votes);
+}
+
+void segmentRadii(Segment& segment, const RadiusBand& band, int* minRadius, int* maxRadius) {
+	int estimate = (std::max(segment.getWidth(), segment.getHeigh()) + 1) / 2;
+	*minRadius = std::max(estimate - band.tolerance, band.minRadius);
+	*maxRadius = std::max(std::min(estimate + band.tolerance + 1, band.maxRadius), *minRadius);
+}
 
-	auto threads_count = std::thread::hardware_concurrency();	// pobranie liczby dostpnych rdzeni obliczeniowych
-	std::vector<std::thread> threads;
+Rect searchBorders(Segment& segment, int width, int height) {
+	Rect borders = segment.getBorders();
+	borders.max.x = std::min(borders.max.x + SEARCH_MARGIN, width - 1);
+	borders.max.y = std::min(borders.max.y + SEARCH_MARGIN, height - 1);
+	borders.min.x = std::max(borders.min.x - SEARCH_MARGIN, 0);
+	borders.min.y = std::max(borders.min.y - SEARCH_MARGIN, 0);
+	return borders;
+}
+
+std::vector <CentersPoint> searchCircles(BinaryImage* contours, std::vector <Segment>& segments, DirectionView directions,
+	int angleTolerance, std::vector <Accumulator>& accumulators, const RadiusBand& radii) {
+	TRACE_SCOPE("searchCircles");
+
+	ThreadPool& pool = ThreadPool::shared();
+	TaskGroup group;
 
 	std::vector <CentersPoint> center;
 
+	// accumulators left from earlier calls are reset in place, so their planes are only reallocated when they grow
 	for (int i = 0; i < segments.size(); ++i)
 	{
-		int boundMin = segments[i].getWidth() / 2 - 10;
-		if (boundMin < 3)
-			boundMin = 3;
-		int boundMax = segments[i].getWidth() / 2 + 10;
-		boundMin = 15;
-		boundMax = 45;
-		Rect borders = segments[i].getBorders();
-		borders.max.x += 5;
-		borders.max.y += 5;
-		borders.min.x -= 5;
-		borders.min.y -= 5;
-		std::vector <CentersPoint> circles;
-		start = false;
-		CentersPoint point(Point(0, 0), 0);
-		int kLast = boundMin;
-		while (kLast < boundMax) {
-			for (int k = kLast; k < (kLast + threads_count) && k < boundMax; ++k) {
-				threads.push_back(std::thread(centerForRadius, image, borders, k, &circles));
-				//circles.push_back(centerForRadius(image, borders, k));
-				//circles.push_back(point);
+		int boundMin, boundMax;
+		segmentRadii(segments[i], radii, &boundMin, &boundMax);
+		prepareStencils(boundMin, boundMax);
+		Rect borders = searchBorders(segments[i], contours->getWidth(), contours->getHeight());
+		if (i < accumulators.size())
+			accumulators[i].reset(borders, boundMin, boundMax);
+		else
+			accumulators.emplace_back(borders, boundMin, boundMax);
+		TRACE_COUNTER("accumulator bytes", accumulators[i].getBytes());
+	}
 
-			}
-			kLast += threads_count;
-			{
-				//time_counter tc;
-				start = true;
-				for (auto& t : threads) {
-					t.join();
-				}
-				threads.clear();
-			}
+	// every (segment, radius) pair is a separate task writing only to its own accumulator plane
+	for (int i = 0; i < segments.size(); ++i)
+		for (int k = accumulators[i].getMinRadius(); k < accumulators[i].getMaxRadius(); ++k) {
+			Accumulator* target = &accumulators[i];
+			pool.submit(&group, [contours, target, k, directions, angleTolerance] {
+				centerForRadius(contours, target, k, directions, angleTolerance);
+			});
 		}
+	pool.wait(&group);
 
+	for (int i = 0; i < segments.size(); ++i) {
+		CentersPoint best = accumulators[i].peak();
+		if (best.count > 0)
+			center.push_back(best);
+	}
 
+	return center;
+}
 
-		int index = 0;
-		int max = circles[0].count;
-		for (int k = 1; k < circles.size(); ++k)
-			if (circles[k].count > max) {
-				max = circles[k].count;
-				index = k;
-			}
-
-		center.push_back(circles[index]);
+double findCircles(BinaryImage* contours, std::vector <Segment>& segments, GrayView circles, GrayView gradientSource, int angleTolerance,
+	const RadiusBand& radii) {
+	auto tic = std::chrono::steady_clock::now();
 
+	DirectionImage directionImage;
+	DirectionView directions;
+	if (!gradientSource.isEmpty()) {
+		directionImage.resize(contours->getWidth(), contours->getHeight());
+		directions = directionImage.view();
+		gradientDirections(gradientSource, contours, directions);
 	}
 
-	for (int i = 0; i < center.size(); ++i)
-		for (int alpha = 0; alpha < 360; ++alpha) {
-			int x = (int)round((float)center[i].point.x + (center[i].radius) * cos(alpha * PI / 180));
-			int y = (int)round((float)center[i].point.y + (center[i].radius) * sin(alpha * PI / 180));
-			circles->data[y][x] = 255;
-		}
+	std::vector <Accumulator> accumulators;
+	markCircles(circles, searchCircles(contours, segments, directions, angleTolerance, accumulators, radii));
 
 	auto toc = std::chrono::steady_clock::now();
 	std::chrono::steady_clock::duration period = toc - tic;
@@ -559,22 +853,38 @@ double findCircles(GrayImage* image, GrayImage* circles) {
 
 #pragma endregion
 
-void drawCircles(RgbImage* rgbImage, GrayImage* circles) {
-
-	int size = rgbImage->getWidth() * rgbImage->getHeight();
-
-	for (int i = 0; i < size; ++i)
-		if (circles->data[0][i] > 0)
-		{
-			rgbImage->data[0][i].g = 0.0;
-			rgbImage->data[0][i].r = 255.0;
-			rgbImage->data[0][i].b = 0.0;
+void markCircles(GrayView circles, const std::vector <CentersPoint>& centers, int firstRow) {
+	TRACE_SCOPE("markCircles");
+
+	for (int i = 0; i < centers.size(); ++i) {
+		if (centers[i].point.y + centers[i].radius < firstRow || centers[i].point.y - centers[i].radius >= firstRow + circles.getHeight())
+			continue;
+		for (const Point& offset : circleStencil(centers[i].radius).offsets) {
+			int x = centers[i].point.x + offset.x;
+			int y = centers[i].point.y + offset.y - firstRow;
+			if (x >= 0 && x < circles.getWidth() && y >= 0 && y < circles.getHeight())
+				circles.row(y)[x] = 255;
 		}
-		else
-		{
-			rgbImage->data[0][i].g /= 3.0;
-			rgbImage->data[0][i].r /= 3.0;
-			rgbImage->data[0][i].b /= 3.0;
+	}
+}
+
+void drawCircles(RgbView rgbImage, GrayView circles) {
+	TRACE_SCOPE("drawCircles");
+
+	parallelRows(rgbImage.getHeight(), ROW_GRAIN, [&](int firstRow, int endRow) {
+		for (int j = firstRow; j < endRow; ++j) {
+			RgbPixel* pixels = rgbImage.row(j);
+			uint8_t* marks = circles.row(j);
+			// every channel is darkened, then the few marked pixels are painted red
+			divideBytesByThree((uint8_t*)pixels, 3 * rgbImage.getWidth());
+			for (int i = 0; i < rgbImage.getWidth(); ++i)
+				if (marks[i] > 0)
+				{
+					pixels[i].g = 0;
+					pixels[i].r = 255;
+					pixels[i].b = 0;
+				}
 		}
+	});
 
 }
\ No newline at end of file
@@ -1,11 +1,23 @@
 #pragma once
 
 #include "BMP.h"
+#include "BinaryImage.h"
+#include <cstdint>
+#include <vector>
 
 const float PI = 3.14159265;
 
 const int DICRETE_LEVEL = 256;
 
+const int MIN_RADIUS = 15;
+const int MAX_RADIUS = 45;
+
+const int GRADIENT_TOLERANCE = 6; // degrees around the gradient direction used for voting
+
+const int NO_DIRECTION = -1;
+
+const int SEARCH_MARGIN = 5; // pixels the Hough search window extends past a segment
+
 const short LOG5[5][5] = { 0, 0, 1, 0, 0,
 						0, 1, 2, 1, 0,
 						1, 2, -16, 2, 1,
@@ -36,13 +48,16 @@ struct Segment {
 
 	void addPoint(Point newPoint);
 
+	// Bounding box and point count of the union of both segments
+	void addSegment(const Segment& other);
+
 	Rect getBorders() { Rect borders(xyMin_, xyMax_); return borders; }
 
 	int getIndex() { return index_; }
 
 	int howMuch() { return count_; }
 
-	int getArea() { return ((this->xyMax_.x - this->xyMin_.x) * (this->xyMax_.y - this->xyMin_.y)); }
+	int64_t getArea() { return ((int64_t)(this->xyMax_.x - this->xyMin_.x) * (this->xyMax_.y - this->xyMin_.y)); }
 
 	int getHeigh() { return (this->xyMax_.y - this->xyMin_.y); }
 
@@ -65,26 +80,189 @@ struct CentersPoint {
 	int radius;
 };
 
-void laplacianOfGauss(GrayImage* imgGr);
+// Integer offsets of the pixels lying on a circle of given radius, ordered by angle.
+// Each pixel appears exactly once, so a contour pixel never votes twice for the same center.
+struct CircleStencil {
+
+	CircleStencil(int radius);
+
+	int getRadius() const { return radius_; }
+
+	// index of the first offset reached at the given angle in degrees, 0..359
+	int atDegree(int degree) const { return firstAtDegree_[((degree % 360) + 360) % 360]; }
+
+	std::vector <Point> offsets;
+
+private:
+	int radius_;
+	int firstAtDegree_[360];
+};
+
+// Stencils are built on first use and shared by every thread for the rest of the process.
+const CircleStencil& circleStencil(int radius);
+
+void prepareStencils(int minRadius = MIN_RADIUS, int maxRadius = MAX_RADIUS);
+
+// Dense (x, y, radius) vote counter covering one segment's search window.
+// Radii are taken from [minRadius, maxRadius); every radius owns its own contiguous plane,
+// so voting for different radii never touches the same memory.
+struct Accumulator {
+
+	Accumulator(Rect borders, int minRadius, int maxRadius);
+
+	// Clears the votes for a new window, keeping the memory when it is large enough
+	void reset(Rect borders, int minRadius, int maxRadius);
+
+	// Counts stop at UINT16_MAX instead of wrapping to zero
+	void increment(int x, int y, int radius) {
+		uint16_t& votes = votes_[index(x, y, radius)];
+		if (votes < UINT16_MAX)
+			++votes;
+	}
+
+	// Votes of a cell inside the borders and radii
+	int getVotes(int x, int y, int radius) { return votes_[index(x, y, radius)]; }
+
+	uint16_t* plane(int radius) { return votes_.data() + (size_t)(radius - minRadius_) * width_ * height_; }
+
+	Rect getBorders() { return borders_; }
+
+	int getMinRadius() { return minRadius_; }
+
+	int getMaxRadius() { return maxRadius_; }
+
+	size_t getBytes() { return (size_t)(maxRadius_ - minRadius_) * width_ * height_ * sizeof(uint16_t); }
+
+	CentersPoint peak();
+
+private:
+	size_t index(int x, int y, int radius) {
+		return ((size_t)(radius - minRadius_) * height_ + (y - borders_.min.y)) * width_ + (x - borders_.min.x);
+	}
+
+	Rect borders_;
+	int minRadius_;
+	int maxRadius_;
+	int width_;
+	int height_;
+	std::vector <uint16_t> votes_;
+};
+
+// Gradient direction of contour pixels in degrees, NO_DIRECTION elsewhere
+typedef Image<int16_t> DirectionImage;
+typedef ImageView<int16_t> DirectionView;
+
+// Writes the LoG of imgGr, normalized to 0..255, into result of the same size. A histogram of
+// DICRETE_LEVEL bins, when given, receives the histogram of result, counted in the same pass.
+void laplacianOfGauss(GrayView imgGr, GrayView result, int64_t* histogram = nullptr);
+
+void laplacianOfGauss(GrayView imgGr);
+
+void normalizeValues(GrayView imgGr);
+
+// Fills histogram with DICRETE_LEVEL bins. Bands of rows are counted in parallel on the shared pool,
+// each into its own histogram, and summed at the end.
+void getHistogram(GrayView img, int64_t* histogram);
+
+// Otsu threshold of a DICRETE_LEVEL bin histogram; pixel count and intensity sum are taken from it
+int threshold_Otsu(const int64_t* histogram);
+
+// Binarizes img at multiplier times its Otsu threshold, found from histogram when it is given
+// (e.g. by laplacianOfGauss) and counted otherwise
+void thresholdImage(GrayView img, float multiplier = 1.0, const int64_t* histogram = nullptr);
+
+void inverseValues(GrayView img);
+
+void inverseValues(BinaryImage* img);
+
+void paintBorders(GrayView img, int width = 2);
+
+void paintBorders(BinaryImage* img, int width = 2);
+
+enum MorphType { DILATION, EROSION };
+
+struct MorphOperation {
+	MorphOperation(MorphType type, int size = 5) { this->type = type; this->size = size; }
+
+	MorphType type;
+	int size;
+};
+
+void morphDilation(GrayView img, int size = 5);
+
+void morphErosion(GrayView img, int size = 5);
+
+// Applies the operations in order, sharing one scratch image; the cost per pixel does not depend on size.
+void morphSequence(GrayView img, const std::vector <MorphOperation>& operations);
+
+// Same operations on a packed mask, 64 pixels at a time; the cost per pixel grows with log(size).
+void morphSequence(BinaryImage* img, const std::vector <MorphOperation>& operations);
+
+void morphSequence(BinaryImage* img, const std::vector <MorphOperation>& operations, MorphBuffers* buffers);
+
+// Union-find building blocks of the labeling, also used by the band labeler
+int findRoot(std::vector <int>& parent, int label);
 
-void normalizeValues(GrayImage* imgGr);
+// Gives the foreground pixel (i, j) a provisional label from its visited neighbours in rows j and j - 1
+void labelPixel(LabelView labels, std::vector <int>& parent, int i, int j);
+
+// Labels 8-connected foreground regions 1..n in two passes and returns n.
+int segmentUnionFind(LabelView imBin);
+
+// Labels the set pixels of mask into labels, which must have the size of the mask.
+int segmentUnionFind(BinaryImage* mask, LabelView labels);
+
+// Keeps only the segments that may be circles, in img and in the segments list
+void removeExceptCircles(LabelView img, std::vector <Segment>& segments);
+
+// Size, point count and aspect test a segment of an image with imageSize pixels must pass to be searched for a circle
+bool isCircleCandidate(Segment& segment, int64_t imageSize, float sizeMultiplier = 0.4, float maxDistortion = 0.4, int pointsLimit = 50);
+
+// Radii searched for a segment: half its larger extent, plus or minus tolerance, within the global
+// limits [minRadius, maxRadius). A circle's contour spans about its diameter, so small segments search
+// a few radii and large ones reach big circles without every segment paying for the whole range.
+struct RadiusBand {
+	RadiusBand(int tolerance = 10, int minRadius = MIN_RADIUS, int maxRadius = MAX_RADIUS) {
+		this->tolerance = tolerance; this->minRadius = minRadius; this->maxRadius = maxRadius;
+	}
+
+	int tolerance;
+	int minRadius;
+	int maxRadius;
+};
 
-void getHistogram(GrayImage* img);
+// Range [*minRadius, *maxRadius) of the segment, empty when the segment is outside the limits
+void segmentRadii(Segment& segment, const RadiusBand& band, int* minRadius, int* maxRadius);
 
-void thresholdImage(GrayImage* img, float multiplier = 1.0);
+// Accumulator borders for a segment: its bounding box grown by SEARCH_MARGIN, clipped to the image
+Rect searchBorders(Segment& segment, int width, int height);
 
-void inverseValues(GrayImage* img);
+// Directions of the contour pixels of row mid, given the gray rows around it and the packed contour row
+void gradientDirectionsRow(const uint8_t* up, const uint8_t* mid, const uint8_t* down, const uint64_t* contours,
+	int width, int16_t* directions);
 
-void paintBorders(GrayImage* img, int width = 2);
+void gradientDirections(GrayView gray, BinaryImage* contours, DirectionView directions);
 
-void morphDilation(GrayImage* img, int size = 5);
+// Votes of the contour pixels inside the accumulator borders for centers of one radius
+void centerForRadius(BinaryImage* contours, Accumulator* accumulator, int radius, DirectionView directions, int angleTolerance);
 
-void morphErosion(GrayImage* img, int size = 5);
+// Votes of the contour pixels inside voters for centers of one radius in a small accumulator window,
+// as when tracking a circle whose center is roughly known. Like the borders in centerForRadius, voters
+// includes its minimum and excludes its maximum. With directions and the same voters as borders the
+// votes are those of centerForRadius that fall into the window.
+void centerInWindow(BinaryImage* contours, Accumulator* accumulator, int radius, Rect voters,
+	DirectionView directions = DirectionView(), int angleTolerance = GRADIENT_TOLERANCE);
 
-void segmentTopDownBottomUp(GrayImage* imBin);
+// Best circle of every segment; accumulators are working memory kept by the caller between calls.
+// With directions every contour pixel votes only along its gradient normal, within angleTolerance degrees.
+std::vector <CentersPoint> searchCircles(BinaryImage* contours, std::vector <Segment>& segments, DirectionView directions,
+	int angleTolerance, std::vector <Accumulator>& accumulators, const RadiusBand& radii = RadiusBand());
 
-void removeExceptCircles(GrayImage* img);
+// Marks the circles found in segments into circles
+double findCircles(BinaryImage* contours, std::vector <Segment>& segments, GrayView circles, GrayView gradientSource = GrayView(),
+	int angleTolerance = GRADIENT_TOLERANCE, const RadiusBand& radii = RadiusBand());
 
-double findCircles(GrayImage* image, GrayImage* circles);
+// Sets the pixels of every circle to 255; circles holds the image rows from firstRow on
+void markCircles(GrayView circles, const std::vector <CentersPoint>& centers, int firstRow = 0);
 
-void drawCircles(RgbImage* img, GrayImage* circles);
\ No newline at end of file
+void drawCircles(RgbView img, GrayView circles);
@@ -0,0 +1,135 @@
+#include "SimdKernels.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// Random input rows of one width; the byte rows start one byte past an aligned address. The BGR row
+// ends where its last pixel does, so a kernel reading past it shows up under -fsanitize=address.
+struct KernelInputs {
+
+	KernelInputs(int width, std::mt19937& random);
+
+	int width;
+	std::vector <int16_t> padded[5];
+	const int16_t* rows[5];
+	std::vector <uint8_t> bgr;
+	std::vector <uint8_t> bgra;
+	std::vector <int16_t> values;
+	std::vector <uint8_t> bytes;
+	std::vector <uint64_t> first;
+	std::vector <uint64_t> second;
+};
+
+KernelInputs::KernelInputs(int width, std::mt19937& random) {
+	this->width = width;
+	for (int k = 0; k < 5; ++k) {
+		padded[k].resize(width + 2 * LOG_PADDING);
+		for (int16_t& value : padded[k])
+			value = (int16_t)(random() % 256);
+		rows[k] = padded[k].data() + LOG_PADDING;
+	}
+	bgr.resize(3 * width + 1);
+	for (uint8_t& value : bgr)
+		value = (uint8_t)random();
+	bgra.resize(4 * width + 1);
+	for (uint8_t& value : bgra)
+		value = (uint8_t)random();
+	values.resize(width);
+	for (int16_t& value : values)
+		value = (int16_t)(random() % 8161) - 4080;
+	bytes.resize(width + 1);
+	for (uint8_t& value : bytes)
+		value = (uint8_t)random();
+	first.resize(width);
+	second.resize(width);
+	for (int i = 0; i < width; ++i) {
+		first[i] = ((uint64_t)random() << 32) | random();
+		second[i] = ((uint64_t)random() << 32) | random();
+	}
+}
+
+// Everything the kernels write for one set of inputs
+struct KernelOutputs {
+
+	bool operator==(const KernelOutputs& other) const {
+		return log == other.log && gray3 == other.gray3 && gray4 == other.gray4 && bits == other.bits
+			&& thresholded == other.thresholded && min == other.min && max == other.max && ored == other.ored
+			&& thirds == other.thirds;
+	}
+
+	std::vector <int16_t> log;
+	std::vector <uint8_t> gray3;
+	std::vector <uint8_t> gray4;
+	std::vector <uint64_t> bits;
+	std::vector <std::vector <uint8_t>> thresholded;
+	uint8_t min = 0;
+	uint8_t max = 0;
+	std::vector <uint64_t> ored;
+	std::vector <uint8_t> thirds;
+};
+
+KernelOutputs runKernels(const KernelInputs& inputs) {
+
+	int width = inputs.width;
+	KernelOutputs outputs;
+	outputs.log.resize(width);
+	logRow(inputs.rows, outputs.log.data(), width);
+
+	outputs.gray3.resize(width);
+	outputs.gray4.resize(width);
+	bgrToGrayRow(inputs.bgr.data() + 1, 3, outputs.gray3.data(), width);
+	bgrToGrayRow(inputs.bgra.data() + 1, 4, outputs.gray4.data(), width);
+
+	// the unused bits of the last word have to be cleared as well
+	outputs.bits.assign((width + 63) / 64, ~(uint64_t)0);
+	lessThanToBits(inputs.values.data(), width, -17, outputs.bits.data());
+
+	const int thresholds[] = { 0, 1, 128, 255, 256 };
+	for (int threshold : thresholds)
+		for (int invert = 0; invert < 2; ++invert) {
+			std::vector <uint8_t> row(inputs.bytes.begin() + 1, inputs.bytes.end());
+			thresholdBytes(row.data(), width, threshold, invert != 0);
+			outputs.thresholded.push_back(row);
+		}
+
+	outputs.min = inputs.bytes[1];
+	outputs.max = inputs.bytes[1];
+	byteRange(inputs.bytes.data() + 1, width, &outputs.min, &outputs.max);
+
+	outputs.ored.resize(width);
+	orWords(outputs.ored.data(), inputs.first.data(), inputs.second.data(), width);
+
+	outputs.thirds.assign(inputs.bytes.begin() + 1, inputs.bytes.end());
+	divideBytesByThree(outputs.thirds.data(), width);
+	return outputs;
+}
+
+// Runs every kernel on random rows of many widths, odd ones and ones around the vector sizes, at every
+// level the CPU supports and compares each level with the scalar one. The 3-channel gray conversion
+// works on 8, 16 or 32 pixels at a time, so the widths around 48 and 96 pixels and the small ones
+// exercise its remainders. Returns 1 on any difference.
+int main() {
+
+	int widths[] = { 1, 2, 3, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 47, 48, 49, 63, 64, 65, 95, 96, 97, 127, 128, 129,
+		255, 333, 1000, 1921 };
+	SimdLevel detected = detectSimdLevel();
+	std::mt19937 random(1);
+	int mismatches = 0;
+	for (int width : widths)
+		for (int repeat = 0; repeat < 4; ++repeat) {
+			KernelInputs inputs(width, random);
+			setSimdLevel(SIMD_SCALAR);
+			KernelOutputs scalar = runKernels(inputs);
+			for (int level = SIMD_SSE2; level <= detected; ++level) {
+				setSimdLevel((SimdLevel)level);
+				if (!(runKernels(inputs) == scalar)) {
+					printf("%s differs from scalar at width %d\n", simdLevelName((SimdLevel)level), width);
+					++mismatches;
+				}
+			}
+		}
+
+	printf("levels up to %s checked, %d mismatches\n", simdLevelName(detected), mismatches);
+	return (mismatches > 0) ? 1 : 0;
+}
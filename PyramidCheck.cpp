@@ -0,0 +1,75 @@
+#include "BMP.h"
+#include "HoughCircleDetector.h"
+#include "Image.h"
+#include "SyntheticImage.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+bool operator<(const CentersPoint& a, const CentersPoint& b) {
+	if (a.point.x != b.point.x)
+		return a.point.x < b.point.x;
+	if (a.point.y != b.point.y)
+		return a.point.y < b.point.y;
+	return a.radius < b.radius;
+}
+
+bool sameCircle(const CentersPoint& a, const CentersPoint& b) {
+	return a.point.x == b.point.x && a.point.y == b.point.y && a.radius == b.radius;
+}
+
+std::vector <CentersPoint> detectSorted(GrayView gray, int pyramid, bool gradientVoting) {
+
+	HoughCircleDetector detector(gradientVoting);
+	detector.pyramid = pyramid;
+	std::vector <CentersPoint> circles = detector.detect(gray);
+	std::sort(circles.begin(), circles.end());
+	return circles;
+}
+
+// Detects the circles of generated 800x600 frames of twenty circles with the full search and with the
+// pyramid search at factors 2 and 4, with and without gradient voting, and prints every circle one finds
+// and the other does not. The pyramid search refines its coarse peaks with the votes of the full search
+// inside the segment's search window and band of radii, so with one circle per segment both have to
+// agree. Returns 1 on any difference.
+int main() {
+
+	int differences = 0;
+	for (uint64_t seed = 1; seed <= 6; ++seed) {
+		SyntheticOptions options;
+		options.width = 800;
+		options.height = 600;
+		options.circles = 20;
+		options.seed = seed;
+		RgbImage rgb(options.width, options.height);
+		generateCircles(options, rgb);
+		GrayImage gray(options.width, options.height);
+		rgbToGray(rgb, gray);
+
+		for (int gradient = 0; gradient < 2; ++gradient) {
+			std::vector <CentersPoint> full = detectSorted(gray, 1, gradient != 0);
+			for (int pyramid = 2; pyramid <= 4; pyramid *= 2) {
+				std::vector <CentersPoint> coarse = detectSorted(gray, pyramid, gradient != 0);
+				int found = 0;
+				for (const CentersPoint& circle : full)
+					if (std::find_if(coarse.begin(), coarse.end(), [&](const CentersPoint& other) { return sameCircle(circle, other); }) == coarse.end()) {
+						printf("seed %d%s: full (%d,%d,%d) n=%d missing from pyramid%d\n", (int)seed, gradient ? " gradient" : "",
+							circle.point.x, circle.point.y, circle.radius, circle.count, pyramid);
+						++found;
+					}
+				for (const CentersPoint& circle : coarse)
+					if (std::find_if(full.begin(), full.end(), [&](const CentersPoint& other) { return sameCircle(circle, other); }) == full.end()) {
+						printf("seed %d%s: pyramid%d (%d,%d,%d) n=%d missing from full\n", (int)seed, gradient ? " gradient" : "",
+							pyramid, circle.point.x, circle.point.y, circle.radius, circle.count);
+						++found;
+					}
+				printf("seed %d%s pyramid%d: %d circles, %d differences\n", (int)seed, gradient ? " gradient" : "", pyramid,
+					(int)full.size(), found);
+				differences += found;
+			}
+		}
+	}
+
+	printf("%d differences\n", differences);
+	return (differences > 0) ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+#include "RandomizedHough.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+int contourCount(BinaryImage* contours, Rect borders) {
+
+	int count = 0;
+	for (int y = borders.min.y; y < borders.max.y; ++y)
+		for (int x = borders.min.x; x < borders.max.x; ++x)
+			if (contours->get(x, y))
+				++count;
+	return count;
+}
+
+// Contour pixels on the stencil of (center, radius) that the full search would count: voters come from
+// [min, max) of borders and the center must lie strictly inside them
+int circleSupport(BinaryImage* contours, Rect borders, Point center, const CircleStencil& stencil) {
+
+	if (center.x <= borders.min.x || center.x >= borders.max.x || center.y <= borders.min.y || center.y >= borders.max.y)
+		return 0;
+	int support = 0;
+	for (const Point& offset : stencil.offsets) {
+		int x = center.x + offset.x;
+		int y = center.y + offset.y;
+		if (x >= borders.min.x && x < borders.max.x && y >= borders.min.y && y < borders.max.y && contours->get(x, y))
+			++support;
+	}
+	return support;
+}
+
+CentersPoint randomizedCircle(BinaryImage* contours, Rect borders, int minRadius, int maxRadius, const RandomizedOptions& options,
+	unsigned seed, RandomizedBuffers* buffers) {
+	TRACE_SCOPE("randomizedCircle");
+
+	CentersPoint best(Point(0, 0), minRadius);
+	best.count = 0;
+	if (minRadius >= maxRadius)
+		return best;
+
+	std::vector <Point>& points = buffers->points;
+	points.clear();
+	for (int y = borders.min.y; y < borders.max.y; ++y)
+		for (int x = borders.min.x; x < borders.max.x; ++x)
+			if (contours->get(x, y))
+				points.push_back(Point(x, y));
+	if (points.size() < 3)
+		return best;
+
+	// every triple defines at most one circle; its center is the intersection of two perpendicular bisectors
+	std::unordered_map <uint64_t, int>& cells = buffers->cells;
+	cells.clear();
+	std::mt19937 random(seed);
+	std::uniform_int_distribution <int> pick(0, (int)points.size() - 1);
+	int spacing = options.minSpacing * options.minSpacing;
+	int cell = options.cellSize;
+	for (int s = 0; s < options.samples; ++s) {
+		Point a = points[pick(random)];
+		Point b = points[pick(random)];
+		Point c = points[pick(random)];
+		int ab = (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y);
+		int bc = (b.x - c.x) * (b.x - c.x) + (b.y - c.y) * (b.y - c.y);
+		int ca = (c.x - a.x) * (c.x - a.x) + (c.y - a.y) * (c.y - a.y);
+		if (ab < spacing || bc < spacing || ca < spacing)
+			continue;
+
+		int64_t d = 2 * ((int64_t)a.x * (b.y - c.y) + (int64_t)b.x * (c.y - a.y) + (int64_t)c.x * (a.y - b.y));
+		if (d == 0)
+			continue;
+		double aa = (double)a.x * a.x + (double)a.y * a.y;
+		double bb = (double)b.x * b.x + (double)b.y * b.y;
+		double cc = (double)c.x * c.x + (double)c.y * c.y;
+		double x = (aa * (b.y - c.y) + bb * (c.y - a.y) + cc * (a.y - b.y)) / d;
+		double y = (aa * (c.x - b.x) + bb * (a.x - c.x) + cc * (b.x - a.x)) / d;
+		double radius = sqrt((x - a.x) * (x - a.x) + (y - a.y) * (y - a.y));
+		if (radius < minRadius - 0.5 || radius >= maxRadius - 0.5)
+			continue;
+		if (x <= borders.min.x || x >= borders.max.x || y <= borders.min.y || y >= borders.max.y)
+			continue;
+
+		uint64_t key = ((uint64_t)(int)round(radius) / cell << 42) | ((uint64_t)(int)round(y) / cell << 21) | ((uint64_t)(int)round(x) / cell);
+		++cells[key];
+	}
+	TRACE_COUNTER("rht points", points.size());
+	TRACE_COUNTER("rht cells", cells.size());
+	if (cells.empty())
+		return best;
+
+	// the most voted cells, ties broken by key so the result does not depend on the hash order
+	std::vector <std::pair<int, uint64_t>> ranked;
+	ranked.reserve(cells.size());
+	for (const auto& entry : cells)
+		ranked.push_back(std::make_pair(entry.second, entry.first));
+	size_t verified = std::min(ranked.size(), (size_t)std::max(options.candidates, 1));
+	std::partial_sort(ranked.begin(), ranked.begin() + verified, ranked.end(),
+		[](const std::pair<int, uint64_t>& left, const std::pair<int, uint64_t>& right) {
+			return left.first > right.first || (left.first == right.first && left.second < right.second);
+		});
+
+	const uint64_t field = (1 << 21) - 1;
+	for (size_t n = 0; n < verified; ++n) {
+		uint64_t key = ranked[n].second;
+		int x = (int)(key & field) * cell;
+		int y = (int)((key >> 21) & field) * cell;
+		int radius = (int)(key >> 42) * cell;
+
+		// the whole cell and one pixel around it, then uphill to the local maximum
+		CentersPoint local(Point(x, y), radius);
+		local.count = -1;
+		for (int r = std::max(radius - 1, minRadius); r <= std::min(radius + cell, maxRadius - 1); ++r) {
+			const CircleStencil& stencil = circleStencil(r);
+			for (int j = y - 1; j <= y + cell; ++j)
+				for (int i = x - 1; i <= x + cell; ++i) {
+					int support = circleSupport(contours, borders, Point(i, j), stencil);
+					if (support > local.count) {
+						local = CentersPoint(Point(i, j), r);
+						local.count = support;
+					}
+				}
+		}
+		for (bool climbing = true; climbing;) {
+			climbing = false;
+			CentersPoint start = local;
+			for (int r = std::max(start.radius - 1, minRadius); r <= std::min(start.radius + 1, maxRadius - 1); ++r) {
+				const CircleStencil& stencil = circleStencil(r);
+				for (int j = start.point.y - 1; j <= start.point.y + 1; ++j)
+					for (int i = start.point.x - 1; i <= start.point.x + 1; ++i) {
+						int support = circleSupport(contours, borders, Point(i, j), stencil);
+						if (support > local.count) {
+							local = CentersPoint(Point(i, j), r);
+							local.count = support;
+							climbing = true;
+						}
+					}
+			}
+		}
+		if (local.count > best.count)
+			best = local;
+	}
+
+	if (best.count < options.minSupport * circleStencil(best.radius).offsets.size())
+		best.count = 0;
+	return best;
+}
+
+std::vector <CentersPoint> searchCirclesRandomized(BinaryImage* contours, std::vector <Segment>& segments,
+	const RandomizedOptions& options, const RadiusBand& radii, std::vector <RandomizedBuffers>& buffers,
+	std::vector <Segment>& failed) {
+	TRACE_SCOPE("searchCirclesRandomized");
+
+	if (buffers.size() < segments.size())
+		buffers.resize(segments.size());
+	std::vector <CentersPoint> peaks(segments.size(), CentersPoint(Point(0, 0), radii.minRadius));
+
+	// each segment draws from its own generator, so the result does not depend on the thread schedule
+	ThreadPool& pool = ThreadPool::shared();
+	TaskGroup group;
+	for (int i = 0; i < segments.size(); ++i) {
+		Rect borders = searchBorders(segments[i], contours->getWidth(), contours->getHeight());
+		int minRadius, maxRadius;
+		segmentRadii(segments[i], radii, &minRadius, &maxRadius);
+		CentersPoint* peak = &peaks[i];
+		RandomizedBuffers* working = &buffers[i];
+		unsigned seed = options.seed + (unsigned)i;
+		pool.submit(&group, [contours, borders, minRadius, maxRadius, &options, seed, working, peak] {
+			*peak = randomizedCircle(contours, borders, minRadius, maxRadius, options, seed, working);
+		});
+	}
+	pool.wait(&group);
+
+	std::vector <CentersPoint> circles;
+	for (int i = 0; i < segments.size(); ++i)
+		if (peaks[i].count > 0)
+			circles.push_back(peaks[i]);
+		else
+			failed.push_back(segments[i]);
+	return circles;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "BinaryImage.h"
+#include "Image.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Settings of the randomized Hough transform (RHT)
+struct RandomizedOptions {
+	int samples = 1500;       // point triples drawn per segment
+	int minSpacing = 6;       // pixels between any two points of a triple, closer points give unstable circles
+	int cellSize = 2;         // pixels per hash cell, along the center coordinates and the radius
+	int candidates = 4;       // best cells verified against the contours
+	float minSupport = 0.3;   // share of the circle pixels that must lie on contours
+	unsigned seed = 1;
+};
+
+// Working memory of one segment search
+struct RandomizedBuffers {
+	std::vector <Point> points;
+	std::unordered_map <uint64_t, int> cells;
+};
+
+// Contour pixels of borders that vote in the full search, the box without its last row and column
+int contourCount(BinaryImage* contours, Rect borders);
+
+// Circle through three contour pixels of borders, drawn at random. Every circle with a radius in
+// [minRadius, maxRadius) and its center inside borders votes for its (x, y, radius) cell in a hash,
+// so memory grows with the number of samples and not with the radius range. The best cells are then
+// verified: around each, the circle with the most contour pixels on its stencil wins, which is the
+// vote count the full Hough search gives the same circle. Returns count 0 below minSupport.
+CentersPoint randomizedCircle(BinaryImage* contours, Rect borders, int minRadius, int maxRadius, const RandomizedOptions& options,
+	unsigned seed, RandomizedBuffers* buffers);
+
+// randomizedCircle of every segment within its radius band, searched in parallel; segments without a verified
+// circle are appended to failed
+std::vector <CentersPoint> searchCirclesRandomized(BinaryImage* contours, std::vector <Segment>& segments,
+	const RandomizedOptions& options, const RadiusBand& radii, std::vector <RandomizedBuffers>& buffers,
+	std::vector <Segment>& failed);
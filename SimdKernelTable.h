@@ -0,0 +1,89 @@
+#pragma once
+
+#include "SimdKernels.h"
+#include <cstdint>
+
+// Internal to the kernels: one table of implementations per instruction set, filled by SimdKernels.cpp
+// (scalar) and SimdKernelsSse2.cpp, SimdKernelsAvx2.cpp, SimdKernelsAvx512.cpp. The vector versions are
+// compiled with target attributes, so the whole program builds without -m flags and each table is only
+// used on CPUs that run it.
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define HT_X86
+#endif
+
+#if defined(__GNUC__)
+#define HT_TARGET(features) __attribute__((target(features)))
+#else
+#define HT_TARGET(features)
+#endif
+
+struct SimdKernelTable {
+	SimdLevel level;
+	void (*logRow)(const int16_t* const rows[5], int16_t* out, int width);
+	void (*bgrToGrayRow)(const uint8_t* src, int channels, uint8_t* dst, int width);
+	void (*lessThanToBits)(const int16_t* src, int width, int16_t limit, uint64_t* bits);
+	void (*thresholdBytes)(uint8_t* row, int width, int threshold, bool invert);
+	void (*byteRange)(const uint8_t* row, int width, uint8_t* min, uint8_t* max);
+	void (*orWords)(uint64_t* dst, const uint64_t* first, const uint64_t* second, int count);
+	void (*divideBytesByThree)(uint8_t* bytes, int count);
+};
+
+const SimdKernelTable& scalarKernels();
+
+#ifdef HT_X86
+const SimdKernelTable& sse2Kernels();
+
+const SimdKernelTable& avx2Kernels();
+
+const SimdKernelTable& avx512Kernels();
+#endif
+
+// Scalar loops from pixel x on, shared by every table for what is left after the last full vector
+
+inline int16_t logPixel(const int16_t* const rows[5], int x) {
+	const int16_t* r = rows[2];
+	int center = r[x - 2] + r[x + 2] + 2 * (r[x - 1] + r[x + 1]) - 16 * r[x];
+	int near = (rows[1][x - 1] + rows[3][x - 1]) + 2 * (rows[1][x] + rows[3][x]) + (rows[1][x + 1] + rows[3][x + 1]);
+	return (int16_t)(center + near + rows[0][x] + rows[4][x]);
+}
+
+// (sum + 1) / 3 for sums up to 765
+inline uint8_t divideByThree(unsigned sum) {
+	return (uint8_t)(((sum + 1) * 43691u) >> 17);
+}
+
+inline void bgrToGrayTail(const uint8_t* src, int channels, uint8_t* dst, int x, int width) {
+	for (; x < width; ++x)
+		dst[x] = divideByThree(src[channels * x] + src[channels * x + 1] + src[channels * x + 2]);
+}
+
+inline void lessThanTail(const int16_t* src, int x, int width, int16_t limit, uint64_t* bits) {
+	for (; x < width; ++x)
+		if (src[x] < limit)
+			bits[x >> 6] |= (uint64_t)1 << (x & 63);
+}
+
+inline void thresholdTail(uint8_t* row, int x, int width, int threshold, bool invert) {
+	for (; x < width; ++x)
+		row[x] = ((row[x] >= threshold) != invert) ? 255 : 0;
+}
+
+inline void byteRangeTail(const uint8_t* row, int x, int width, uint8_t* min, uint8_t* max) {
+	for (; x < width; ++x) {
+		if (row[x] < *min)
+			*min = row[x];
+		if (row[x] > *max)
+			*max = row[x];
+	}
+}
+
+inline void orTail(uint64_t* dst, const uint64_t* first, const uint64_t* second, int w, int count) {
+	for (; w < count; ++w)
+		dst[w] = first[w] | second[w];
+}
+
+inline void divideByThreeTail(uint8_t* bytes, int i, int count) {
+	for (; i < count; ++i)
+		bytes[i] /= 3;
+}
@@ -0,0 +1,177 @@
+#include "SimdKernels.h"
+#include "SimdKernelTable.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(HT_X86) && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+// Portable versions, also the only ones on other architectures. The compiler may still vectorize them
+// for the baseline of the target.
+
+void logRowScalar(const int16_t* const rows[5], int16_t* out, int width) {
+	for (int x = 0; x < width; ++x)
+		out[x] = logPixel(rows, x);
+}
+
+void bgrToGrayRowScalar(const uint8_t* src, int channels, uint8_t* dst, int width) {
+	if (channels == 4)
+		bgrToGrayTail(src, 4, dst, 0, width);
+	else
+		bgrToGrayTail(src, 3, dst, 0, width);
+}
+
+void lessThanToBitsScalar(const int16_t* src, int width, int16_t limit, uint64_t* bits) {
+	memset(bits, 0, sizeof(uint64_t) * ((width + 63) / 64));
+	lessThanTail(src, 0, width, limit, bits);
+}
+
+void thresholdBytesScalar(uint8_t* row, int width, int threshold, bool invert) {
+	thresholdTail(row, 0, width, threshold, invert);
+}
+
+void byteRangeScalar(const uint8_t* row, int width, uint8_t* min, uint8_t* max) {
+	byteRangeTail(row, 0, width, min, max);
+}
+
+void orWordsScalar(uint64_t* dst, const uint64_t* first, const uint64_t* second, int count) {
+	orTail(dst, first, second, 0, count);
+}
+
+void divideBytesByThreeScalar(uint8_t* bytes, int count) {
+	divideByThreeTail(bytes, 0, count);
+}
+
+const SimdKernelTable& scalarKernels() {
+	static const SimdKernelTable table = { SIMD_SCALAR, logRowScalar, bgrToGrayRowScalar, lessThanToBitsScalar,
+		thresholdBytesScalar, byteRangeScalar, orWordsScalar, divideBytesByThreeScalar };
+	return table;
+}
+
+SimdLevel probeSimdLevel() {
+
+#if !defined(HT_X86)
+	return SIMD_SCALAR;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int leaves = info[0];
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0;
+	// the OS has to save the ymm (bits 1, 2) and zmm (bits 5 to 7) registers
+	uint64_t enabled = avx ? _xgetbv(0) : 0;
+	bool avx2 = false;
+	bool avx512 = false;
+	if (leaves >= 7) {
+		__cpuidex(info, 7, 0);
+		avx2 = (enabled & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+		avx512 = (enabled & 0xE6) == 0xE6 && (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0;
+	}
+	return avx512 ? SIMD_AVX512 : avx2 ? SIMD_AVX2 : sse2 ? SIMD_SSE2 : SIMD_SCALAR;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+		return SIMD_AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return SIMD_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SIMD_SSE2;
+	return SIMD_SCALAR;
+#endif
+}
+
+SimdLevel detectSimdLevel() {
+	static const SimdLevel detected = probeSimdLevel();
+	return detected;
+}
+
+const char* simdLevelName(SimdLevel level) {
+	switch (level) {
+	case SIMD_SSE2: return "sse2";
+	case SIMD_AVX2: return "avx2";
+	case SIMD_AVX512: return "avx512";
+	default: return "scalar";
+	}
+}
+
+const SimdKernelTable& kernelsFor(SimdLevel level) {
+
+	if (level > detectSimdLevel())
+		level = detectSimdLevel();
+#ifdef HT_X86
+	if (level == SIMD_AVX512)
+		return avx512Kernels();
+	if (level == SIMD_AVX2)
+		return avx2Kernels();
+	if (level == SIMD_SSE2)
+		return sse2Kernels();
+#endif
+	return scalarKernels();
+}
+
+// HT_SIMD, or the detected level when it is unset or unknown
+SimdLevel requestedSimdLevel() {
+
+	const char* text = getenv("HT_SIMD");
+	if (text != nullptr)
+		for (int level = SIMD_SCALAR; level <= SIMD_AVX512; ++level)
+			if (strcmp(text, simdLevelName((SimdLevel)level)) == 0)
+				return (SimdLevel)level;
+	return detectSimdLevel();
+}
+
+std::atomic<const SimdKernelTable*> activeKernels{ nullptr };
+
+const SimdKernelTable& kernels() {
+
+	const SimdKernelTable* table = activeKernels.load(std::memory_order_acquire);
+	if (table == nullptr) {
+		static const SimdKernelTable* initial = &kernelsFor(requestedSimdLevel());
+		// a table set by setSimdLevel in the meantime is kept
+		activeKernels.compare_exchange_strong(table, initial);
+		table = activeKernels.load(std::memory_order_acquire);
+	}
+	return *table;
+}
+
+SimdLevel simdLevel() {
+	return kernels().level;
+}
+
+SimdLevel setSimdLevel(SimdLevel level) {
+	const SimdKernelTable& table = kernelsFor(level);
+	activeKernels.store(&table, std::memory_order_release);
+	return table.level;
+}
+
+void logRow(const int16_t* const rows[5], int16_t* out, int width) {
+	kernels().logRow(rows, out, width);
+}
+
+void bgrToGrayRow(const uint8_t* src, int channels, uint8_t* dst, int width) {
+	kernels().bgrToGrayRow(src, channels, dst, width);
+}
+
+void lessThanToBits(const int16_t* src, int width, int16_t limit, uint64_t* bits) {
+	kernels().lessThanToBits(src, width, limit, bits);
+}
+
+void thresholdBytes(uint8_t* row, int width, int threshold, bool invert) {
+	kernels().thresholdBytes(row, width, threshold, invert);
+}
+
+void byteRange(const uint8_t* row, int width, uint8_t* min, uint8_t* max) {
+	kernels().byteRange(row, width, min, max);
+}
+
+void orWords(uint64_t* dst, const uint64_t* first, const uint64_t* second, int count) {
+	kernels().orWords(dst, first, second, count);
+}
+
+void divideBytesByThree(uint8_t* bytes, int count) {
+	kernels().divideBytesByThree(bytes, count);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+// The kernels run the widest instruction set the CPU supports. It is detected once, on the first call,
+// and can be lowered with the environment variable HT_SIMD=scalar|sse2|avx2|avx512, e.g. for A/B timing.
+// A level above what the CPU supports is clamped to the supported one.
+enum SimdLevel { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512 };
+
+// Widest level of this CPU; AVX-512 needs the F and BW extensions
+SimdLevel detectSimdLevel();
+
+// Level the kernels use
+SimdLevel simdLevel();
+
+// Switches the kernels to level, clamped to detectSimdLevel(), and returns the level now in use.
+// Call it while no kernel runs.
+SimdLevel setSimdLevel(SimdLevel level);
+
+const char* simdLevelName(SimdLevel level);
+
+// Padding in pixels on each side of the rows passed to logRow
+const int LOG_PADDING = 2;
+
+// One output row of the 5x5 LoG kernel. rows[k] points at pixel 0 of input row y - 2 + k and every row
+// must be readable LOG_PADDING pixels before its start and after its end; zero padding stands for pixels
+// outside the image. The kernel holds only the taps 1, 2 and -16, so it is evaluated as
+//   row y:      p[x-2] + p[x+2] + 2 (p[x-1] + p[x+1]) - 16 p[x]
+//   rows y+-1:  s[x-1] + 2 s[x] + s[x+1],  with s the sum of both rows
+//   rows y+-2:  p[x]
+// using shifts and adds on 8, 16 or 32 16-bit lanes.
+void logRow(const int16_t* const rows[5], int16_t* out, int width);
+
+// Gray value (b + g + r + 1) / 3 of width pixels stored as BGR (channels 3) or BGRA (channels 4).
+// The division is a multiply and shift, BGRA rows are converted a vector of pixels per step.
+void bgrToGrayRow(const uint8_t* src, int channels, uint8_t* dst, int width);
+
+// Packs src[x] < limit for width values into bits, bit x % 64 of word x / 64; unused bits of the last word are 0.
+void lessThanToBits(const int16_t* src, int width, int16_t limit, uint64_t* bits);
+
+// row[x] = (row[x] >= threshold) ? 255 : 0, or the opposite when invert is set
+void thresholdBytes(uint8_t* row, int width, int threshold, bool invert);
+
+// Lowers min and raises max to the smallest and largest of width values
+void byteRange(const uint8_t* row, int width, uint8_t* min, uint8_t* max);
+
+// dst[w] = first[w] | second[w]; dst may be first or second
+void orWords(uint64_t* dst, const uint64_t* first, const uint64_t* second, int count);
+
+// bytes[i] /= 3
+void divideBytesByThree(uint8_t* bytes, int count);
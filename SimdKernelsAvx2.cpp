@@ -0,0 +1,158 @@
+#include "SimdKernelTable.h"
+#ifdef HT_X86
+#include <cstring>
+#include <immintrin.h>
+
+HT_TARGET("avx2")
+void logRowAvx2(const int16_t* const rows[5], int16_t* out, int width) {
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		const int16_t* r = rows[2];
+		__m256i c = _mm256_loadu_si256((const __m256i*)(r + x));
+		__m256i outer = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(r + x - 2)), _mm256_loadu_si256((const __m256i*)(r + x + 2)));
+		__m256i inner = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(r + x - 1)), _mm256_loadu_si256((const __m256i*)(r + x + 1)));
+		__m256i center = _mm256_sub_epi16(_mm256_add_epi16(outer, _mm256_slli_epi16(inner, 1)), _mm256_slli_epi16(c, 4));
+
+		__m256i left = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(rows[1] + x - 1)), _mm256_loadu_si256((const __m256i*)(rows[3] + x - 1)));
+		__m256i middle = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(rows[1] + x)), _mm256_loadu_si256((const __m256i*)(rows[3] + x)));
+		__m256i right = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(rows[1] + x + 1)), _mm256_loadu_si256((const __m256i*)(rows[3] + x + 1)));
+		__m256i near = _mm256_add_epi16(_mm256_add_epi16(left, right), _mm256_slli_epi16(middle, 1));
+
+		__m256i far = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(rows[0] + x)), _mm256_loadu_si256((const __m256i*)(rows[4] + x)));
+		_mm256_storeu_si256((__m256i*)(out + x), _mm256_add_epi16(_mm256_add_epi16(center, near), far));
+	}
+
+	// pixels left over after the last full vector
+	for (; x < width; ++x)
+		out[x] = logPixel(rows, x);
+}
+
+// Gray values of eight pixels with the channels in the low three bytes of every 32-bit lane
+HT_TARGET("avx2")
+inline void storeGrayOfPixelsAvx2(__m256i pixels, uint8_t* dst) {
+	const __m256i low = _mm256_set1_epi32(0xFF);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i third = _mm256_set1_epi16((short)43691);
+	__m256i sum = _mm256_add_epi32(_mm256_and_si256(pixels, low), _mm256_and_si256(_mm256_srli_epi32(pixels, 8), low));
+	sum = _mm256_add_epi32(_mm256_add_epi32(sum, _mm256_and_si256(_mm256_srli_epi32(pixels, 16), low)), one);
+	// sums fit in the low 16 bits of every lane, the high halves are zero
+	__m256i gray = _mm256_srli_epi16(_mm256_mulhi_epu16(sum, third), 1);
+	// the packs work within 128-bit halves, each half ends up with its four values in the low bytes
+	gray = _mm256_packs_epi32(gray, gray);
+	gray = _mm256_packus_epi16(gray, gray);
+	uint32_t packed[2] = { (uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(gray)),
+		(uint32_t)_mm_cvtsi128_si32(_mm256_extracti128_si256(gray, 1)) };
+	memcpy(dst, packed, 8);
+}
+
+HT_TARGET("avx2")
+void bgrToGrayRowAvx2(const uint8_t* src, int channels, uint8_t* dst, int width) {
+	int x = 0;
+
+	if (channels == 4)
+		for (; x + 8 <= width; x += 8)
+			storeGrayOfPixelsAvx2(_mm256_loadu_si256((const __m256i*)(src + 4 * x)), dst + x);
+	else {
+		// the 24 bytes of eight pixels are loaded without reading past them, each half gets four pixels
+		// and the byte shuffle spreads them to one per 32-bit lane
+		const __m256i loaded = _mm256_setr_epi32(-1, -1, -1, -1, -1, -1, 0, 0);
+		const __m256i halves = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+		const __m256i spread = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		for (; x + 8 <= width; x += 8) {
+			__m256i bytes = _mm256_maskload_epi32((const int*)(src + 3 * x), loaded);
+			storeGrayOfPixelsAvx2(_mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(bytes, halves), spread), dst + x);
+		}
+	}
+	bgrToGrayTail(src, channels, dst, x, width);
+}
+
+HT_TARGET("avx2")
+void lessThanToBitsAvx2(const int16_t* src, int width, int16_t limit, uint64_t* bits) {
+	memset(bits, 0, sizeof(uint64_t) * ((width + 63) / 64));
+
+	int x = 0;
+	const __m256i bound = _mm256_set1_epi16(limit);
+	for (; x + 32 <= width; x += 32) {
+		__m256i first = _mm256_cmpgt_epi16(bound, _mm256_loadu_si256((const __m256i*)(src + x)));
+		__m256i second = _mm256_cmpgt_epi16(bound, _mm256_loadu_si256((const __m256i*)(src + x + 16)));
+		// packs interleaves the 128-bit halves of both inputs, the permute restores pixel order
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(first, second), 0xD8);
+		uint64_t mask = (uint32_t)_mm256_movemask_epi8(packed);
+		bits[x >> 6] |= mask << (x & 63);
+	}
+	lessThanTail(src, x, width, limit, bits);
+}
+
+HT_TARGET("avx2")
+void thresholdBytesAvx2(uint8_t* row, int width, int threshold, bool invert) {
+	int x = 0;
+
+	// thresholds outside 1..255 give the same value for every byte and are left to the scalar loop
+	if (threshold >= 1 && threshold <= 255) {
+		const __m256i bound = _mm256_set1_epi8((char)threshold);
+		const __m256i flip = invert ? _mm256_set1_epi8(-1) : _mm256_setzero_si256();
+		for (; x + 32 <= width; x += 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i*)(row + x));
+			// unsigned v >= threshold as max(v, threshold) == v
+			__m256i above = _mm256_cmpeq_epi8(_mm256_max_epu8(v, bound), v);
+			_mm256_storeu_si256((__m256i*)(row + x), _mm256_xor_si256(above, flip));
+		}
+	}
+	thresholdTail(row, x, width, threshold, invert);
+}
+
+HT_TARGET("avx2")
+void byteRangeAvx2(const uint8_t* row, int width, uint8_t* min, uint8_t* max) {
+	int x = 0;
+
+	if (width >= 32) {
+		__m256i low = _mm256_set1_epi8((char)*min);
+		__m256i high = _mm256_set1_epi8((char)*max);
+		for (; x + 32 <= width; x += 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i*)(row + x));
+			low = _mm256_min_epu8(low, v);
+			high = _mm256_max_epu8(high, v);
+		}
+		uint8_t lanes[2][32];
+		_mm256_storeu_si256((__m256i*)lanes[0], low);
+		_mm256_storeu_si256((__m256i*)lanes[1], high);
+		byteRangeTail(lanes[0], 0, 32, min, max);
+		byteRangeTail(lanes[1], 0, 32, min, max);
+	}
+	byteRangeTail(row, x, width, min, max);
+}
+
+HT_TARGET("avx2")
+void orWordsAvx2(uint64_t* dst, const uint64_t* first, const uint64_t* second, int count) {
+	int w = 0;
+
+	for (; w + 4 <= count; w += 4)
+		_mm256_storeu_si256((__m256i*)(dst + w),
+			_mm256_or_si256(_mm256_loadu_si256((const __m256i*)(first + w)), _mm256_loadu_si256((const __m256i*)(second + w))));
+	orTail(dst, first, second, w, count);
+}
+
+// floor(v / 3) = (v * 21846) >> 16 for v up to 255, on 16-bit lanes
+HT_TARGET("avx2")
+void divideBytesByThreeAvx2(uint8_t* bytes, int count) {
+	int i = 0;
+
+	const __m256i third = _mm256_set1_epi16(21846);
+	for (; i + 16 <= count; i += 16) {
+		__m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(bytes + i)));
+		__m256i divided = _mm256_mulhi_epu16(v, third);
+		__m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(divided), _mm256_extracti128_si256(divided, 1));
+		_mm_storeu_si128((__m128i*)(bytes + i), packed);
+	}
+	divideByThreeTail(bytes, i, count);
+}
+
+const SimdKernelTable& avx2Kernels() {
+	static const SimdKernelTable table = { SIMD_AVX2, logRowAvx2, bgrToGrayRowAvx2, lessThanToBitsAvx2,
+		thresholdBytesAvx2, byteRangeAvx2, orWordsAvx2, divideBytesByThreeAvx2 };
+	return table;
+}
+
+#endif
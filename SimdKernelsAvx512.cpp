@@ -0,0 +1,153 @@
+#include "SimdKernelTable.h"
+#ifdef HT_X86
+#include <cstring>
+
+// GCC 12 warns that the undefined source vector inside the AVX-512 conversion and shift intrinsics may
+// be used uninitialized; the warning comes from its own headers
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+
+HT_TARGET("avx512f,avx512bw")
+void logRowAvx512(const int16_t* const rows[5], int16_t* out, int width) {
+	int x = 0;
+
+	for (; x + 32 <= width; x += 32) {
+		const int16_t* r = rows[2];
+		__m512i c = _mm512_loadu_si512(r + x);
+		__m512i outer = _mm512_add_epi16(_mm512_loadu_si512(r + x - 2), _mm512_loadu_si512(r + x + 2));
+		__m512i inner = _mm512_add_epi16(_mm512_loadu_si512(r + x - 1), _mm512_loadu_si512(r + x + 1));
+		__m512i center = _mm512_sub_epi16(_mm512_add_epi16(outer, _mm512_slli_epi16(inner, 1)), _mm512_slli_epi16(c, 4));
+
+		__m512i left = _mm512_add_epi16(_mm512_loadu_si512(rows[1] + x - 1), _mm512_loadu_si512(rows[3] + x - 1));
+		__m512i middle = _mm512_add_epi16(_mm512_loadu_si512(rows[1] + x), _mm512_loadu_si512(rows[3] + x));
+		__m512i right = _mm512_add_epi16(_mm512_loadu_si512(rows[1] + x + 1), _mm512_loadu_si512(rows[3] + x + 1));
+		__m512i near = _mm512_add_epi16(_mm512_add_epi16(left, right), _mm512_slli_epi16(middle, 1));
+
+		__m512i far = _mm512_add_epi16(_mm512_loadu_si512(rows[0] + x), _mm512_loadu_si512(rows[4] + x));
+		_mm512_storeu_si512(out + x, _mm512_add_epi16(_mm512_add_epi16(center, near), far));
+	}
+
+	// pixels left over after the last full vector
+	for (; x < width; ++x)
+		out[x] = logPixel(rows, x);
+}
+
+// Gray values of sixteen pixels with the channels in the low three bytes of every 32-bit lane
+HT_TARGET("avx512f,avx512bw")
+inline __m128i grayOfPixelsAvx512(__m512i pixels) {
+	const __m512i low = _mm512_set1_epi32(0xFF);
+	const __m512i one = _mm512_set1_epi32(1);
+	const __m512i third = _mm512_set1_epi16((short)43691);
+	__m512i sum = _mm512_add_epi32(_mm512_and_si512(pixels, low), _mm512_and_si512(_mm512_srli_epi32(pixels, 8), low));
+	sum = _mm512_add_epi32(_mm512_add_epi32(sum, _mm512_and_si512(_mm512_srli_epi32(pixels, 16), low)), one);
+	// sums fit in the low 16 bits of every lane, the high halves are zero
+	return _mm512_cvtepi32_epi8(_mm512_srli_epi16(_mm512_mulhi_epu16(sum, third), 1));
+}
+
+HT_TARGET("avx512f,avx512bw")
+void bgrToGrayRowAvx512(const uint8_t* src, int channels, uint8_t* dst, int width) {
+	int x = 0;
+
+	if (channels == 4)
+		for (; x + 16 <= width; x += 16)
+			_mm_storeu_si128((__m128i*)(dst + x), grayOfPixelsAvx512(_mm512_loadu_si512(src + 4 * x)));
+	else {
+		// the 48 bytes of sixteen pixels are loaded without reading past them, every 128-bit lane gets four
+		// pixels and the byte shuffle spreads them to one per 32-bit lane
+		const __m512i quarters = _mm512_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6, 6, 7, 8, 9, 9, 10, 11, 12);
+		const __m512i spread = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+		for (; x + 16 <= width; x += 16) {
+			__m512i bytes = _mm512_maskz_loadu_epi8(((__mmask64)1 << 48) - 1, src + 3 * x);
+			__m512i pixels = _mm512_shuffle_epi8(_mm512_permutexvar_epi32(quarters, bytes), spread);
+			_mm_storeu_si128((__m128i*)(dst + x), grayOfPixelsAvx512(pixels));
+		}
+	}
+	bgrToGrayTail(src, channels, dst, x, width);
+}
+
+HT_TARGET("avx512f,avx512bw")
+void lessThanToBitsAvx512(const int16_t* src, int width, int16_t limit, uint64_t* bits) {
+	memset(bits, 0, sizeof(uint64_t) * ((width + 63) / 64));
+
+	int x = 0;
+	const __m512i bound = _mm512_set1_epi16(limit);
+	for (; x + 32 <= width; x += 32) {
+		uint64_t mask = _mm512_cmplt_epi16_mask(_mm512_loadu_si512(src + x), bound);
+		bits[x >> 6] |= mask << (x & 63);
+	}
+	lessThanTail(src, x, width, limit, bits);
+}
+
+HT_TARGET("avx512f,avx512bw")
+void thresholdBytesAvx512(uint8_t* row, int width, int threshold, bool invert) {
+	int x = 0;
+
+	// thresholds outside 1..255 give the same value for every byte and are left to the scalar loop
+	if (threshold >= 1 && threshold <= 255) {
+		const __m512i bound = _mm512_set1_epi8((char)threshold);
+		for (; x + 64 <= width; x += 64) {
+			__m512i v = _mm512_loadu_si512(row + x);
+			__mmask64 above = invert ? _mm512_cmplt_epu8_mask(v, bound) : _mm512_cmpge_epu8_mask(v, bound);
+			_mm512_storeu_si512(row + x, _mm512_movm_epi8(above));
+		}
+	}
+	thresholdTail(row, x, width, threshold, invert);
+}
+
+HT_TARGET("avx512f,avx512bw")
+void byteRangeAvx512(const uint8_t* row, int width, uint8_t* min, uint8_t* max) {
+	int x = 0;
+
+	if (width >= 64) {
+		__m512i low = _mm512_set1_epi8((char)*min);
+		__m512i high = _mm512_set1_epi8((char)*max);
+		for (; x + 64 <= width; x += 64) {
+			__m512i v = _mm512_loadu_si512(row + x);
+			low = _mm512_min_epu8(low, v);
+			high = _mm512_max_epu8(high, v);
+		}
+		uint8_t lanes[2][64];
+		_mm512_storeu_si512(lanes[0], low);
+		_mm512_storeu_si512(lanes[1], high);
+		byteRangeTail(lanes[0], 0, 64, min, max);
+		byteRangeTail(lanes[1], 0, 64, min, max);
+	}
+	byteRangeTail(row, x, width, min, max);
+}
+
+HT_TARGET("avx512f,avx512bw")
+void orWordsAvx512(uint64_t* dst, const uint64_t* first, const uint64_t* second, int count) {
+	int w = 0;
+
+	for (; w + 8 <= count; w += 8)
+		_mm512_storeu_si512(dst + w, _mm512_or_si512(_mm512_loadu_si512(first + w), _mm512_loadu_si512(second + w)));
+	orTail(dst, first, second, w, count);
+}
+
+// floor(v / 3) = (v * 21846) >> 16 for v up to 255, on 16-bit lanes
+HT_TARGET("avx512f,avx512bw")
+void divideBytesByThreeAvx512(uint8_t* bytes, int count) {
+	int i = 0;
+
+	const __m512i third = _mm512_set1_epi16(21846);
+	for (; i + 32 <= count; i += 32) {
+		__m512i v = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(bytes + i)));
+		_mm256_storeu_si256((__m256i*)(bytes + i), _mm512_cvtepi16_epi8(_mm512_mulhi_epu16(v, third)));
+	}
+	divideByThreeTail(bytes, i, count);
+}
+
+const SimdKernelTable& avx512Kernels() {
+	static const SimdKernelTable table = { SIMD_AVX512, logRowAvx512, bgrToGrayRowAvx512, lessThanToBitsAvx512,
+		thresholdBytesAvx512, byteRangeAvx512, orWordsAvx512, divideBytesByThreeAvx512 };
+	return table;
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
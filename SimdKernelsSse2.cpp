@@ -0,0 +1,174 @@
+#include "SimdKernelTable.h"
+#ifdef HT_X86
+#include <cstring>
+#include <immintrin.h>
+
+HT_TARGET("sse2")
+void logRowSse2(const int16_t* const rows[5], int16_t* out, int width) {
+	int x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		const int16_t* r = rows[2];
+		__m128i c = _mm_loadu_si128((const __m128i*)(r + x));
+		__m128i outer = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(r + x - 2)), _mm_loadu_si128((const __m128i*)(r + x + 2)));
+		__m128i inner = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(r + x - 1)), _mm_loadu_si128((const __m128i*)(r + x + 1)));
+		__m128i center = _mm_sub_epi16(_mm_add_epi16(outer, _mm_slli_epi16(inner, 1)), _mm_slli_epi16(c, 4));
+
+		__m128i left = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(rows[1] + x - 1)), _mm_loadu_si128((const __m128i*)(rows[3] + x - 1)));
+		__m128i middle = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(rows[1] + x)), _mm_loadu_si128((const __m128i*)(rows[3] + x)));
+		__m128i right = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(rows[1] + x + 1)), _mm_loadu_si128((const __m128i*)(rows[3] + x + 1)));
+		__m128i near = _mm_add_epi16(_mm_add_epi16(left, right), _mm_slli_epi16(middle, 1));
+
+		__m128i far = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(rows[0] + x)), _mm_loadu_si128((const __m128i*)(rows[4] + x)));
+		_mm_storeu_si128((__m128i*)(out + x), _mm_add_epi16(_mm_add_epi16(center, near), far));
+	}
+
+	// pixels left over after the last full vector
+	for (; x < width; ++x)
+		out[x] = logPixel(rows, x);
+}
+
+HT_TARGET("sse2")
+void bgrToGrayRowSse2(const uint8_t* src, int channels, uint8_t* dst, int width) {
+	int x = 0;
+
+	const __m128i third = _mm_set1_epi16((short)43691);
+	if (channels != 4) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i one = _mm_set1_epi16(1);
+		for (; x + 32 <= width; x += 32) {
+			// without a byte shuffle, five rounds of interleaving the first three vectors with the last three
+			// turn the 96 bytes of 32 pixels into two vectors of blue, two of green and two of red
+			__m128i bytes[6];
+			for (int k = 0; k < 6; ++k)
+				bytes[k] = _mm_loadu_si128((const __m128i*)(src + 3 * x + 16 * k));
+			for (int round = 0; round < 5; ++round) {
+				__m128i mixed[6];
+				for (int k = 0; k < 3; ++k) {
+					mixed[2 * k] = _mm_unpacklo_epi8(bytes[k], bytes[k + 3]);
+					mixed[2 * k + 1] = _mm_unpackhi_epi8(bytes[k], bytes[k + 3]);
+				}
+				for (int k = 0; k < 6; ++k)
+					bytes[k] = mixed[k];
+			}
+
+			for (int half = 0; half < 2; ++half) {
+				const __m128i& blue = bytes[half];
+				const __m128i& green = bytes[2 + half];
+				const __m128i& red = bytes[4 + half];
+				__m128i low = _mm_add_epi16(_mm_unpacklo_epi8(blue, zero), _mm_unpacklo_epi8(green, zero));
+				low = _mm_add_epi16(_mm_add_epi16(low, _mm_unpacklo_epi8(red, zero)), one);
+				__m128i high = _mm_add_epi16(_mm_unpackhi_epi8(blue, zero), _mm_unpackhi_epi8(green, zero));
+				high = _mm_add_epi16(_mm_add_epi16(high, _mm_unpackhi_epi8(red, zero)), one);
+				low = _mm_srli_epi16(_mm_mulhi_epu16(low, third), 1);
+				high = _mm_srli_epi16(_mm_mulhi_epu16(high, third), 1);
+				_mm_storeu_si128((__m128i*)(dst + x + 16 * half), _mm_packus_epi16(low, high));
+			}
+		}
+		bgrToGrayTail(src, 3, dst, x, width);
+		return;
+	}
+
+	const __m128i low = _mm_set1_epi32(0xFF);
+	const __m128i one = _mm_set1_epi32(1);
+	for (; x + 4 <= width; x += 4) {
+		__m128i pixels = _mm_loadu_si128((const __m128i*)(src + 4 * x));
+		__m128i sum = _mm_add_epi32(_mm_and_si128(pixels, low), _mm_and_si128(_mm_srli_epi32(pixels, 8), low));
+		sum = _mm_add_epi32(_mm_add_epi32(sum, _mm_and_si128(_mm_srli_epi32(pixels, 16), low)), one);
+		// sums fit in the low 16 bits of every lane, the high halves are zero
+		__m128i gray = _mm_srli_epi16(_mm_mulhi_epu16(sum, third), 1);
+		gray = _mm_packs_epi32(gray, gray);
+		gray = _mm_packus_epi16(gray, gray);
+		uint32_t packed = (uint32_t)_mm_cvtsi128_si32(gray);
+		memcpy(dst + x, &packed, 4);
+	}
+	bgrToGrayTail(src, 4, dst, x, width);
+}
+
+HT_TARGET("sse2")
+void lessThanToBitsSse2(const int16_t* src, int width, int16_t limit, uint64_t* bits) {
+	memset(bits, 0, sizeof(uint64_t) * ((width + 63) / 64));
+
+	int x = 0;
+	const __m128i bound = _mm_set1_epi16(limit);
+	for (; x + 16 <= width; x += 16) {
+		__m128i first = _mm_cmplt_epi16(_mm_loadu_si128((const __m128i*)(src + x)), bound);
+		__m128i second = _mm_cmplt_epi16(_mm_loadu_si128((const __m128i*)(src + x + 8)), bound);
+		uint64_t mask = (uint16_t)_mm_movemask_epi8(_mm_packs_epi16(first, second));
+		bits[x >> 6] |= mask << (x & 63);
+	}
+	lessThanTail(src, x, width, limit, bits);
+}
+
+HT_TARGET("sse2")
+void thresholdBytesSse2(uint8_t* row, int width, int threshold, bool invert) {
+	int x = 0;
+
+	// thresholds outside 1..255 give the same value for every byte and are left to the scalar loop
+	if (threshold >= 1 && threshold <= 255) {
+		const __m128i bound = _mm_set1_epi8((char)threshold);
+		const __m128i flip = invert ? _mm_set1_epi8(-1) : _mm_setzero_si128();
+		for (; x + 16 <= width; x += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(row + x));
+			// unsigned v >= threshold as max(v, threshold) == v
+			__m128i above = _mm_cmpeq_epi8(_mm_max_epu8(v, bound), v);
+			_mm_storeu_si128((__m128i*)(row + x), _mm_xor_si128(above, flip));
+		}
+	}
+	thresholdTail(row, x, width, threshold, invert);
+}
+
+HT_TARGET("sse2")
+void byteRangeSse2(const uint8_t* row, int width, uint8_t* min, uint8_t* max) {
+	int x = 0;
+
+	if (width >= 16) {
+		__m128i low = _mm_set1_epi8((char)*min);
+		__m128i high = _mm_set1_epi8((char)*max);
+		for (; x + 16 <= width; x += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(row + x));
+			low = _mm_min_epu8(low, v);
+			high = _mm_max_epu8(high, v);
+		}
+		uint8_t lanes[2][16];
+		_mm_storeu_si128((__m128i*)lanes[0], low);
+		_mm_storeu_si128((__m128i*)lanes[1], high);
+		byteRangeTail(lanes[0], 0, 16, min, max);
+		byteRangeTail(lanes[1], 0, 16, min, max);
+	}
+	byteRangeTail(row, x, width, min, max);
+}
+
+HT_TARGET("sse2")
+void orWordsSse2(uint64_t* dst, const uint64_t* first, const uint64_t* second, int count) {
+	int w = 0;
+
+	for (; w + 2 <= count; w += 2)
+		_mm_storeu_si128((__m128i*)(dst + w),
+			_mm_or_si128(_mm_loadu_si128((const __m128i*)(first + w)), _mm_loadu_si128((const __m128i*)(second + w))));
+	orTail(dst, first, second, w, count);
+}
+
+// floor(v / 3) = (v * 21846) >> 16 for v up to 255, on 16-bit lanes
+HT_TARGET("sse2")
+void divideBytesByThreeSse2(uint8_t* bytes, int count) {
+	int i = 0;
+
+	const __m128i third = _mm_set1_epi16(21846);
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= count; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(bytes + i));
+		__m128i low = _mm_mulhi_epu16(_mm_unpacklo_epi8(v, zero), third);
+		__m128i high = _mm_mulhi_epu16(_mm_unpackhi_epi8(v, zero), third);
+		_mm_storeu_si128((__m128i*)(bytes + i), _mm_packus_epi16(low, high));
+	}
+	divideByThreeTail(bytes, i, count);
+}
+
+const SimdKernelTable& sse2Kernels() {
+	static const SimdKernelTable table = { SIMD_SSE2, logRowSse2, bgrToGrayRowSse2, lessThanToBitsSse2,
+		thresholdBytesSse2, byteRangeSse2, orWordsSse2, divideBytesByThreeSse2 };
+	return table;
+}
+
+#endif
@@ -0,0 +1,249 @@
+#include "StreamingDetector.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+
+StreamingDetector::StreamingDetector(int bandHeight, bool gradientVoting, int angleTolerance) : band_(0, 0) {
+	this->bandHeight = bandHeight;
+	this->gradientVoting = gradientVoting;
+	this->angleTolerance = angleTolerance;
+	morphology = { MorphOperation(DILATION, 5), MorphOperation(DILATION, 5), MorphOperation(EROSION, 7) };
+}
+
+std::vector <CentersPoint> StreamingDetector::detect(MappedBmp* bmpImage) {
+	TRACE_SCOPE("StreamingDetector::detect");
+
+	width_ = bmpImage->getWidth();
+	height_ = bmpImage->getHeight();
+	wordsPerRow_ = (width_ + 63) / 64;
+
+	// an operation of spacing spc changes rows up to 2 * spc away from a band edge it can not see past,
+	// and the Hough window reaches SEARCH_MARGIN rows below the last row of a segment
+	halo_ = 0;
+	for (const MorphOperation& operation : morphology)
+		halo_ += 2 * ((operation.size % 2 == 1) ? ((operation.size - 1) / 2) : (operation.size / 2));
+	halo_ = std::max(halo_, SEARCH_MARGIN + 1);
+	// the window also holds a whole segment of the largest searched circle, whatever the band height
+	capacity_ = 2 * (std::max(bandHeight, 2 * radii.maxRadius) + halo_ + SEARCH_MARGIN);
+
+	window_.assign((size_t)capacity_ * wordsPerRow_, 0);
+	if (gradientVoting) {
+		directions_.resize(width_, capacity_);
+		grayRows_.resize(width_, 3);
+	}
+	labelRows_.resize(width_, 2);
+	parent_.assign(1, 0);
+	stats_.assign(1, Segment(Point(0, 0), 0));
+	circles_.clear();
+	received_ = 0;
+	nextBand_ = 0;
+	searchTime_ = 0;
+	skipped_ = 0;
+
+	frontEnd_.measure(bmpImage);
+	frontEnd_.streamContours(bmpImage, [this](int y, const uint64_t* contours, const uint8_t* gray) {
+		addRow(y, contours, gray);
+	});
+
+	return circles_;
+}
+
+void StreamingDetector::addRow(int y, const uint64_t* contours, const uint8_t* gray) {
+
+	std::copy(contours, contours + wordsPerRow_, windowRow(y));
+
+	// directions of row y - 1 need the gray rows on both sides of it, the first and last rows have none
+	if (gradientVoting) {
+		std::copy(gray, gray + width_, grayRows_.row(y % 3));
+		if (y == 0 || y == height_ - 1)
+			std::fill(directions_.row(y % capacity_), directions_.row(y % capacity_) + width_, (int16_t)NO_DIRECTION);
+		if (y >= 2)
+			gradientDirectionsRow(grayRows_.row((y - 2) % 3), grayRows_.row((y - 1) % 3), grayRows_.row(y % 3),
+				windowRow(y - 1), width_, directions_.row((y - 1) % capacity_));
+	}
+	received_ = y + 1;
+
+	while (nextBand_ < height_ && received_ >= std::min(nextBand_ + bandHeight + halo_, height_))
+		closeBand();
+}
+
+void StreamingDetector::closeBand() {
+	TRACE_SCOPE("StreamingDetector::closeBand");
+
+	int first = nextBand_;
+	int last = std::min(first + bandHeight, height_);
+	int top = std::max(first - halo_, 0);
+	int bottom = std::min(last + halo_, height_);
+
+	band_.resize(width_, bottom - top);
+	for (int y = top; y < bottom; ++y)
+		std::copy(windowRow(y), windowRow(y) + wordsPerRow_, band_.row(y - top));
+	morphSequence(&band_, morphology);
+
+	for (int y = first; y < last; ++y)
+		labelRow(band_.row(y - top), y);
+
+	std::vector <Segment> finished;
+	finishSegments(last - 1, finished);
+	search(finished);
+
+	nextBand_ = last;
+}
+
+void StreamingDetector::labelRow(const uint64_t* mask, int y) {
+
+	// the two label rows alternate; a view with a signed stride puts row y - 1 at index 0 and row y at index 1
+	int32_t* current = labelRows_.row(y & 1);
+	int32_t* previous = labelRows_.row((y + 1) & 1);
+	std::fill(current, current + width_, 0);
+	LabelView labels = (y == 0) ? LabelView(current, width_, 1, 0) : LabelView(previous, width_, 2, current - previous);
+	int j = (y == 0) ? 0 : 1;
+
+	for (int w = 0; w < wordsPerRow_; ++w)
+		for (uint64_t bits = mask[w]; bits != 0; bits &= bits - 1) {
+			int i = w * 64 + lowestBit(bits);
+			labelPixel(labels, parent_, i, j);
+			int label = current[i];
+			if (label == (int)stats_.size())
+				stats_.push_back(Segment(Point(i, y), label));
+			else
+				stats_[label].addPoint(Point(i, y));
+		}
+}
+
+void StreamingDetector::finishSegments(int y, std::vector <Segment>& finished) {
+
+	// statistics of provisional labels are gathered in their roots
+	for (int k = 1; k < parent_.size(); ++k) {
+		int root = findRoot(parent_, k);
+		if (root != k)
+			stats_[root].addSegment(stats_[k]);
+	}
+
+	// roots met on row y continue in the next band under new, consecutive labels
+	std::vector <int> next(parent_.size(), 0);
+	std::vector <Segment> open(1, Segment(Point(0, 0), 0));
+	int32_t* row = labelRows_.row(y & 1);
+	if (y < height_ - 1)
+		for (int i = 0; i < width_; ++i)
+			if (row[i] != 0) {
+				int root = findRoot(parent_, row[i]);
+				if (next[root] == 0) {
+					next[root] = (int)open.size();
+					open.push_back(stats_[root]);
+				}
+				row[i] = next[root];
+			}
+
+	for (int k = 1; k < parent_.size(); ++k)
+		if (parent_[k] == k && next[k] == 0)
+			finished.push_back(stats_[k]);
+
+	parent_.resize(open.size());
+	for (int k = 0; k < parent_.size(); ++k)
+		parent_[k] = k;
+	stats_.swap(open);
+}
+
+// Contour pixels and directions of one Hough window, copied out of the row ring. The window starts
+// on a word boundary so rows are copied a word at a time.
+struct SearchRegion {
+
+	SearchRegion(int width, int height, Point origin) : contours(width, height) { this->origin = origin; }
+
+	BinaryImage contours;
+	DirectionImage directions;
+	Point origin;
+};
+
+void StreamingDetector::search(std::vector <Segment>& finished) {
+	TRACE_SCOPE("StreamingDetector::search");
+	auto tic = std::chrono::steady_clock::now();
+
+	ThreadPool& pool = ThreadPool::shared();
+	TaskGroup group;
+
+	std::deque <SearchRegion> regions;
+	std::deque <Accumulator> accumulators;
+
+	for (Segment& segment : finished) {
+		if (!isCircleCandidate(segment, (int64_t)width_ * height_))
+			continue;
+		Rect borders = searchBorders(segment, width_, height_);
+		if (borders.min.y < received_ - capacity_) {
+			++skipped_;
+			continue;
+		}
+
+		Point origin(borders.min.x / 64 * 64, borders.min.y);
+		int width = borders.max.x + 1 - origin.x;
+		int height = borders.max.y + 1 - origin.y;
+		regions.emplace_back(width, height, origin);
+		SearchRegion& region = regions.back();
+		int words = region.contours.getWordsPerRow();
+		for (int y = 0; y < height; ++y) {
+			const uint64_t* source = windowRow(origin.y + y) + origin.x / 64;
+			uint64_t* target = region.contours.row(y);
+			std::copy(source, source + words, target);
+			target[words - 1] &= region.contours.lastWordMask();
+		}
+		if (gradientVoting) {
+			region.directions.resize(width, height);
+			for (int y = 0; y < height; ++y) {
+				const int16_t* source = directions_.row((origin.y + y) % capacity_) + origin.x;
+				std::copy(source, source + width, region.directions.row(y));
+			}
+		}
+
+		Rect local(Point(borders.min.x - origin.x, 0), Point(borders.max.x - origin.x, height - 1));
+		int minRadius, maxRadius;
+		segmentRadii(segment, radii, &minRadius, &maxRadius);
+		prepareStencils(minRadius, maxRadius);
+		accumulators.emplace_back(local, minRadius, maxRadius);
+	}
+
+	for (int n = 0; n < accumulators.size(); ++n)
+		for (int k = accumulators[n].getMinRadius(); k < accumulators[n].getMaxRadius(); ++k) {
+			Accumulator* target = &accumulators[n];
+			BinaryImage* contours = &regions[n].contours;
+			DirectionView directions = regions[n].directions.view();
+			int tolerance = angleTolerance;
+			pool.submit(&group, [contours, target, k, directions, tolerance] {
+				centerForRadius(contours, target, k, directions, tolerance);
+			});
+		}
+	pool.wait(&group);
+
+	for (int n = 0; n < accumulators.size(); ++n) {
+		CentersPoint best = accumulators[n].peak();
+		if (best.count > 0) {
+			best.point = Point(best.point.x + regions[n].origin.x, best.point.y + regions[n].origin.y);
+			circles_.push_back(best);
+		}
+	}
+
+	auto toc = std::chrono::steady_clock::now();
+	searchTime_ += std::chrono::duration_cast<std::chrono::nanoseconds>(toc - tic).count() / (1000.0 * 1000.0);
+}
+
+void writeCircles(MappedBmp* bmpImage, const std::vector <CentersPoint>& circles, const char* fname, int bandHeight) {
+
+	int width = bmpImage->getWidth();
+	int height = bmpImage->getHeight();
+	BmpWriter writer(fname, width, height);
+
+	RgbImage rgbBand;
+	GrayImage marks;
+	for (int first = 0; first < height; first += bandHeight) {
+		int rows = std::min(bandHeight, height - first);
+		rgbBand.resize(width, rows);
+		marks.resize(width, rows);
+		bmpImage->toRgb(rgbBand, first);
+		marks.fill(0);
+		markCircles(marks, circles, first);
+		drawCircles(rgbBand, marks);
+		writer.writeRows(rgbBand);
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "BMP.h"
+#include "BinaryImage.h"
+#include "FrontEnd.h"
+#include "Image.h"
+#include <vector>
+
+// Circle detection over horizontal bands, for images that do not fit in memory.
+// Contour rows stream from FrontEnd into a ring window of rows. Each band is closed by running the
+// morphology on the band plus a halo of rows on both sides, labeling it row by row with a union-find
+// that carries segments still open at the band end over to the next band, and searching every segment
+// that ended inside the band in a Hough window cropped around it. Memory grows with bandHeight times
+// the image width, not with the image.
+// Segments taller than the row window (about two bands) are skipped, see getSkippedSegments.
+struct StreamingDetector {
+
+	StreamingDetector(int bandHeight = 256, bool gradientVoting = false, int angleTolerance = GRADIENT_TOLERANCE);
+
+	// Centers are in the row order of MappedBmp
+	std::vector <CentersPoint> detect(MappedBmp* bmpImage);
+
+	// Time spent in the Hough search during the last detect, in milliseconds
+	double getSearchTime() { return searchTime_; }
+
+	int getSkippedSegments() { return skipped_; }
+
+	int bandHeight;
+	bool gradientVoting;
+	int angleTolerance;
+	RadiusBand radii;
+	std::vector <MorphOperation> morphology;
+
+private:
+	void addRow(int y, const uint64_t* contours, const uint8_t* gray);
+
+	void closeBand();
+
+	void labelRow(const uint64_t* mask, int y);
+
+	// Segments with no pixel on row y, or all segments when y is the last row, leave the union-find
+	void finishSegments(int y, std::vector <Segment>& finished);
+
+	void search(std::vector <Segment>& finished);
+
+	uint64_t* windowRow(int y) { return window_.data() + (size_t)(y % capacity_) * wordsPerRow_; }
+
+	FrontEnd frontEnd_;
+	int width_ = 0;
+	int height_ = 0;
+	int wordsPerRow_ = 0;
+	int halo_ = 0;
+	int capacity_ = 0;
+	int received_ = 0;
+	int nextBand_ = 0;
+	std::vector <uint64_t> window_;
+	DirectionImage directions_;
+	GrayImage grayRows_;
+	BinaryImage band_;
+	LabelImage labelRows_;
+	std::vector <int> parent_;
+	std::vector <Segment> stats_;
+	std::vector <CentersPoint> circles_;
+	double searchTime_ = 0;
+	int skipped_ = 0;
+};
+
+// Writes the source image with the circles drawn like drawCircles, one band of rows at a time
+void writeCircles(MappedBmp* bmpImage, const std::vector <CentersPoint>& circles, const char* fname, int bandHeight = 256);
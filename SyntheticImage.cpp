@@ -0,0 +1,155 @@
+#include "SyntheticImage.h"
+#include <algorithm>
+#include <cmath>
+
+// xorshift64*
+uint64_t SyntheticRandom::next() {
+	state_ ^= state_ >> 12;
+	state_ ^= state_ << 25;
+	state_ ^= state_ >> 27;
+	return state_ * 0x2545F4914F6CDD1Dull;
+}
+
+// Box-Muller transform of two uniforms in (0, 1]
+double SyntheticRandom::normal() {
+	double first = ((next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+	double second = ((next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+	return sqrt(-2.0 * log(first)) * cos(2.0 * PI * second);
+}
+
+// Share of pixel (x, y) inside the circle, from samples x samples points spread over the pixel
+double pixelCoverage(const RefinedCircle& circle, int x, int y, int samples) {
+
+	// pixels well inside or outside skip the sampling; half the pixel diagonal is below 0.75
+	double distance = sqrt((x - circle.x) * (x - circle.x) + (y - circle.y) * (y - circle.y));
+	if (distance <= circle.radius - 0.75)
+		return 1;
+	if (distance >= circle.radius + 0.75)
+		return 0;
+	int inside = 0;
+	for (int j = 0; j < samples; ++j)
+		for (int i = 0; i < samples; ++i) {
+			double dx = x - 0.5 + (i + 0.5) / samples - circle.x;
+			double dy = y - 0.5 + (j + 0.5) / samples - circle.y;
+			if (dx * dx + dy * dy <= circle.radius * circle.radius)
+				++inside;
+		}
+	return (double)inside / (samples * samples);
+}
+
+std::vector <RefinedCircle> generateCircles(const SyntheticOptions& options, RgbView image) {
+
+	SyntheticRandom random(options.seed);
+	std::vector <RefinedCircle> circles;
+
+	// the image border is kept free, the front end clears it
+	const int margin = 10;
+	for (int tries = 0; circles.size() < options.circles && tries < 1000 * std::max(options.circles, 1); ++tries) {
+		double radius;
+		if (options.distribution == NORMAL_RADII) {
+			double mean = (options.minRadius + options.maxRadius) / 2.0;
+			double deviation = (options.maxRadius - options.minRadius) / 4.0;
+			radius = mean + deviation * random.normal();
+			radius = std::min(std::max(radius, (double)options.minRadius), (double)options.maxRadius);
+		}
+		else
+			radius = random.uniformReal(options.minRadius, options.maxRadius);
+		if (options.width - 2 * (radius + margin) < 1 || options.height - 2 * (radius + margin) < 1)
+			continue;
+		double x = random.uniformReal(radius + margin, options.width - radius - margin - 1);
+		double y = random.uniformReal(radius + margin, options.height - radius - margin - 1);
+
+		bool free = true;
+		for (const RefinedCircle& other : circles) {
+			double distance = sqrt((x - other.x) * (x - other.x) + (y - other.y) * (y - other.y));
+			double needed = radius + other.radius + options.gap - options.overlap * (2 * std::min(radius, other.radius) + options.gap);
+			if (distance < needed) {
+				free = false;
+				break;
+			}
+		}
+		if (free)
+			circles.push_back(RefinedCircle(x, y, radius));
+	}
+
+	// discs are drawn into the red channel first, then the noise is added and copied to the others;
+	// where discs overlap the pixel keeps the larger coverage
+	for (int y = 0; y < image.getHeight(); ++y) {
+		RgbPixel* pixels = image.row(y);
+		for (int x = 0; x < image.getWidth(); ++x)
+			pixels[x].r = (uint8_t)options.background;
+	}
+	int samples = std::max(options.supersampling, 1);
+	for (const RefinedCircle& circle : circles)
+		for (int y = (int)floor(circle.y - circle.radius - 1); y <= (int)ceil(circle.y + circle.radius + 1); ++y) {
+			RgbPixel* pixels = image.row(y);
+			for (int x = (int)floor(circle.x - circle.radius - 1); x <= (int)ceil(circle.x + circle.radius + 1); ++x) {
+				double coverage = pixelCoverage(circle, x, y, samples);
+				int level = (int)round(options.background + coverage * (options.foreground - options.background));
+				if (abs(level - options.background) > abs(pixels[x].r - options.background))
+					pixels[x].r = (uint8_t)level;
+			}
+		}
+	for (int y = 0; y < image.getHeight(); ++y) {
+		RgbPixel* pixels = image.row(y);
+		for (int x = 0; x < image.getWidth(); ++x) {
+			int value = pixels[x].r;
+			if (options.noise > 0)
+				value += random.uniform(-options.noise, options.noise);
+			uint8_t level = (uint8_t)std::min(std::max(value, 0), 255);
+			pixels[x].r = level;
+			pixels[x].g = level;
+			pixels[x].b = level;
+		}
+	}
+	return circles;
+}
+
+DetectionScore scoreDetections(const std::vector <RefinedCircle>& truth, const std::vector <CentersPoint>& detections,
+	double centerTolerance, double radiusTolerance) {
+
+	std::vector <RefinedCircle> circles;
+	for (const CentersPoint& detection : detections)
+		circles.push_back(RefinedCircle(detection.point.x, detection.point.y, detection.radius));
+	return scoreDetections(truth, circles, centerTolerance, radiusTolerance);
+}
+
+DetectionScore scoreDetections(const std::vector <RefinedCircle>& truth, const std::vector <RefinedCircle>& detections,
+	double centerTolerance, double radiusTolerance) {
+
+	DetectionScore score;
+	score.truth = (int)truth.size();
+	score.detected = (int)detections.size();
+
+	std::vector <bool> used(truth.size(), false);
+	for (const RefinedCircle& detection : detections) {
+		int best = -1;
+		double bestDistance = 0;
+		for (int t = 0; t < truth.size(); ++t) {
+			if (used[t] || fabs(truth[t].radius - detection.radius) > radiusTolerance)
+				continue;
+			double distance = sqrt((truth[t].x - detection.x) * (truth[t].x - detection.x)
+				+ (truth[t].y - detection.y) * (truth[t].y - detection.y));
+			if (distance <= centerTolerance && (best < 0 || distance < bestDistance)) {
+				best = t;
+				bestDistance = distance;
+			}
+		}
+		if (best < 0)
+			continue;
+		used[best] = true;
+		++score.matched;
+		score.centerError += bestDistance;
+		score.radiusError += fabs(truth[best].radius - detection.radius);
+		score.radiusBias += detection.radius - truth[best].radius;
+	}
+
+	if (score.matched > 0) {
+		score.centerError /= score.matched;
+		score.radiusError /= score.matched;
+		score.radiusBias /= score.matched;
+	}
+	score.precision = (score.detected > 0) ? (double)score.matched / score.detected : 1.0;
+	score.recall = (score.truth > 0) ? (double)score.matched / score.truth : 1.0;
+	return score;
+}
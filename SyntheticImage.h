@@ -0,0 +1,72 @@
+#pragma once
+
+#include "BMP.h"
+#include "CircleRefinement.h"
+#include "Image.h"
+#include <cstdint>
+#include <vector>
+
+enum RadiusDistribution { UNIFORM_RADII, NORMAL_RADII };
+
+// Settings of a generated test image: dark filled circles on a light background with uniform noise.
+// Centers and radii are real numbers, and edge pixels get the share of the disc they cover.
+struct SyntheticOptions {
+	int width = 640;
+	int height = 480;
+	int circles = 12;
+	int minRadius = 18;
+	int maxRadius = 40;                       // included
+	int supersampling = 4;                    // samples per pixel along each axis for the coverage of edge pixels
+	RadiusDistribution distribution = UNIFORM_RADII; // NORMAL_RADII: mean in the middle of the range, deviation a quarter of it
+	int noise = 2;                            // pixel values vary by up to this much either way
+	float overlap = 0;                        // 0 keeps circles gap pixels apart, 1 lets a circle touch the inside of another
+	int gap = 15;
+	int background = 200;
+	int foreground = 70;
+	uint64_t seed = 1;
+};
+
+// Small generator with the same sequence on every platform, unlike the distributions of <random>
+struct SyntheticRandom {
+
+	SyntheticRandom(uint64_t seed) { state_ = seed * 0x9E3779B97F4A7C15ull + 1; }
+
+	uint64_t next();
+
+	// Uniform in [low, high]
+	int uniform(int low, int high) { return low + (int)(next() % (uint64_t)(high - low + 1)); }
+
+	// Uniform in [low, high)
+	double uniformReal(double low, double high) { return low + (high - low) * ((next() >> 11) * (1.0 / 9007199254740992.0)); }
+
+	// Standard normal
+	double normal();
+
+private:
+	uint64_t state_;
+};
+
+// Draws the circles into image and returns them as ground truth, pixel x covering x - 0.5 .. x + 0.5.
+// Circles are placed at random until options.circles fit, or give up after many misses, so fewer may
+// come back for crowded settings.
+std::vector <RefinedCircle> generateCircles(const SyntheticOptions& options, RgbView image);
+
+// How well detections match the ground truth. A detection matches the nearest unmatched true circle whose
+// center is within centerTolerance pixels and whose radius differs by at most radiusTolerance.
+struct DetectionScore {
+	int truth = 0;
+	int detected = 0;
+	int matched = 0;
+	double precision = 0;
+	double recall = 0;
+	double centerError = 0; // mean over the matched circles, pixels
+	double radiusError = 0;
+	double radiusBias = 0;  // mean of detected minus true radius
+};
+
+DetectionScore scoreDetections(const std::vector <RefinedCircle>& truth, const std::vector <CentersPoint>& detections,
+	double centerTolerance = 3, double radiusTolerance = 3);
+
+// Same for sub-pixel detections
+DetectionScore scoreDetections(const std::vector <RefinedCircle>& truth, const std::vector <RefinedCircle>& detections,
+	double centerTolerance = 3, double radiusTolerance = 3);
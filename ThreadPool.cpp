@@ -0,0 +1,147 @@
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
+
+// pool and queue of the worker running on the current thread, if any
+thread_local ThreadPool* workerPool = nullptr;
+thread_local unsigned workerIndex = 0;
+
+ThreadPool::ThreadPool(unsigned threads) {
+	if (threads < 1)
+		threads = 1;
+	for (unsigned i = 0; i < threads; ++i)
+		queues_.push_back(std::make_unique<Queue>());
+	for (unsigned i = 0; i < threads; ++i)
+		workers_.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex_);
+		stop_ = true;
+	}
+	wakeUp_.notify_all();
+	for (auto& t : workers_)
+		t.join();
+}
+
+ThreadPool& ThreadPool::shared() {
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::submit(TaskGroup* group, std::function<void()> task) {
+	++group->pending;
+
+	// tasks spawned by a worker stay on its own queue, the others are spread round robin
+	// counted before the push, so a concurrent takeTask never takes queued_ below zero
+	unsigned index = (workerPool == this) ? workerIndex : nextQueue_++ % queues_.size();
+	++queued_;
+	{
+		std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+		queues_[index]->tasks.push_back(Task{ std::move(task), group });
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex_);
+	}
+	wakeUp_.notify_one();
+}
+
+void ThreadPool::wait(TaskGroup* group) {
+	unsigned index = (workerPool == this) ? workerIndex : 0;
+	while (group->pending > 0) {
+		Task task;
+		if (takeTask(index, task)) {
+			run(task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex_);
+		finished_.wait(lock, [&] { return group->pending == 0 || queued_ > 0; });
+	}
+	if (group->error) {
+		std::exception_ptr error = group->error;
+		group->error = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+bool ThreadPool::takeTask(unsigned index, Task& task) {
+	if (queued_ == 0)
+		return false;
+
+	{
+		Queue& own = *queues_[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			--queued_;
+			return true;
+		}
+	}
+
+	for (size_t k = 1; k < queues_.size(); ++k) {
+		Queue& victim = *queues_[(index + k) % queues_.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			--queued_;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::run(Task& task) {
+	// a throwing task still counts as finished, or wait would never return
+	try {
+		task.function();
+	}
+	catch (...) {
+		std::lock_guard<std::mutex> lock(task.group->errorMutex);
+		if (!task.group->error)
+			task.group->error = std::current_exception();
+	}
+	if (--task.group->pending == 0) {
+		std::lock_guard<std::mutex> lock(sleepMutex_);
+		finished_.notify_all();
+	}
+}
+
+void ThreadPool::workerLoop(unsigned index) {
+	workerPool = this;
+	TRACE_THREAD_NAME("worker " + std::to_string(index));
+	workerIndex = index;
+	while (true) {
+		Task task;
+		if (takeTask(index, task)) {
+			run(task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex_);
+		wakeUp_.wait(lock, [&] { return stop_ || queued_ > 0; });
+		if (stop_ && queued_ == 0)
+			return;
+	}
+}
+
+void parallelRows(int rows, int grain, const std::function<void(int firstRow, int endRow)>& body) {
+
+	if (rows <= 0)
+		return;
+	ThreadPool& pool = ThreadPool::shared();
+	int bands = std::min((rows + std::max(grain, 1) - 1) / std::max(grain, 1), 4 * (int)pool.getSize());
+	if (bands <= 1 || pool.getSize() <= 1) {
+		body(0, rows);
+		return;
+	}
+
+	TaskGroup group;
+	for (int b = 0; b < bands; ++b) {
+		int firstRow = (int)((int64_t)rows * b / bands);
+		int endRow = (int)((int64_t)rows * (b + 1) / bands);
+		pool.submit(&group, [&body, firstRow, endRow] { body(firstRow, endRow); });
+	}
+	pool.wait(&group);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the tasks of one caller, so several callers can share a pool and wait only for their own work.
+// The first exception thrown by one of the tasks is kept and rethrown by wait.
+struct TaskGroup {
+	std::atomic<size_t> pending{ 0 };
+	std::mutex errorMutex;
+	std::exception_ptr error;
+};
+
+// Persistent pool of worker threads. Every worker owns a task queue and takes its newest task first;
+// a worker with an empty queue steals the oldest task of another worker.
+struct ThreadPool {
+
+	ThreadPool(unsigned threads = std::thread::hardware_concurrency());
+
+	~ThreadPool();
+
+	void submit(TaskGroup* group, std::function<void()> task);
+
+	// Blocks until every task of the group is finished. The calling thread runs queued tasks meanwhile.
+	// Rethrows the first exception of the group's tasks once all of them are done.
+	void wait(TaskGroup* group);
+
+	unsigned getSize() { return (unsigned)workers_.size(); }
+
+	static ThreadPool& shared();
+
+private:
+	struct Task {
+		std::function<void()> function;
+		TaskGroup* group;
+	};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void workerLoop(unsigned index);
+
+	bool takeTask(unsigned index, Task& task);
+
+	void run(Task& task);
+
+	std::vector<std::unique_ptr<Queue>> queues_;
+	std::vector<std::thread> workers_;
+	std::atomic<unsigned> nextQueue_{ 0 };
+	std::atomic<size_t> queued_{ 0 };
+	std::mutex sleepMutex_;
+	std::condition_variable wakeUp_;
+	std::condition_variable finished_;
+	bool stop_ = false;
+};
+
+// Rows per band below which parallelRows does not split pixelwise work further
+const int ROW_GRAIN = 16;
+
+// Runs body(firstRow, endRow) over bands that cover rows [0, rows) on the shared pool and returns when
+// every band is done. Bands hold at least grain rows, and there are up to four per worker so that uneven
+// bands even out; work too small for two bands runs on the calling thread. Bands write disjoint rows,
+// values they reduce are merged by the body, e.g. under a mutex after the band is done.
+void parallelRows(int rows, int grain, const std::function<void(int firstRow, int endRow)>& body);
+
+// Blocking first in, first out queue holding at most capacity items. Producers wait while it is full and
+// consumers while it is empty; after close, pop drains the remaining items and then returns false.
+template <typename T>
+struct BoundedQueue {
+
+	BoundedQueue(size_t capacity) { capacity_ = (capacity < 1) ? 1 : capacity; }
+
+	void push(T item) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		notFull_.wait(lock, [&] { return items_.size() < capacity_; });
+		items_.push_back(std::move(item));
+		notEmpty_.notify_one();
+	}
+
+	bool pop(T& item) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		notEmpty_.wait(lock, [&] { return !items_.empty() || closed_; });
+		if (items_.empty())
+			return false;
+		item = std::move(items_.front());
+		items_.pop_front();
+		notFull_.notify_one();
+		return true;
+	}
+
+	void close() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		closed_ = true;
+		notEmpty_.notify_all();
+	}
+
+private:
+	std::mutex mutex_;
+	std::condition_variable notFull_;
+	std::condition_variable notEmpty_;
+	std::deque<T> items_;
+	size_t capacity_;
+	bool closed_ = false;
+};
@@ -0,0 +1,152 @@
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// phase 'X' is a scope of duration nanoseconds, phase 'C' a counter of the given value
+struct TraceEvent {
+	const char* name;
+	char phase;
+	int64_t start;
+	int64_t value;
+};
+
+// Events of one thread. They are owned by the registry, so they outlive threads that finish before the export.
+struct TraceThread {
+	int id;
+	std::string name;
+	std::mutex mutex;
+	std::vector <TraceEvent> events;
+};
+
+std::atomic<bool> traceRecording{ false };
+std::mutex traceThreadsMutex;
+std::vector <std::unique_ptr<TraceThread>> traceThreads;
+const std::chrono::steady_clock::time_point traceOrigin = std::chrono::steady_clock::now();
+
+thread_local TraceThread* currentTraceThread = nullptr;
+
+int64_t traceNow() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceOrigin).count();
+}
+
+TraceThread* traceThread() {
+	if (currentTraceThread == nullptr) {
+		std::lock_guard<std::mutex> lock(traceThreadsMutex);
+		traceThreads.push_back(std::make_unique<TraceThread>());
+		currentTraceThread = traceThreads.back().get();
+		currentTraceThread->id = (int)traceThreads.size();
+		currentTraceThread->name = (currentTraceThread->id == 1) ? "main" : "thread " + std::to_string(currentTraceThread->id);
+	}
+	return currentTraceThread;
+}
+
+void traceRecord(const char* name, char phase, int64_t start, int64_t value) {
+	TraceThread* thread = traceThread();
+	std::lock_guard<std::mutex> lock(thread->mutex);
+	thread->events.push_back(TraceEvent{ name, phase, start, value });
+}
+
+void traceStart() {
+	traceThread();
+	traceRecording = true;
+}
+
+void traceStop() {
+	traceRecording = false;
+}
+
+bool traceEnabled() {
+	return traceRecording.load(std::memory_order_relaxed);
+}
+
+void traceClear() {
+	std::lock_guard<std::mutex> lock(traceThreadsMutex);
+	for (auto& thread : traceThreads) {
+		std::lock_guard<std::mutex> threadLock(thread->mutex);
+		thread->events.clear();
+	}
+}
+
+void traceThreadName(const std::string& name) {
+	TraceThread* thread = traceThread();
+	std::lock_guard<std::mutex> lock(thread->mutex);
+	thread->name = name;
+}
+
+void traceCounter(const char* name, int64_t value) {
+	if (traceEnabled())
+		traceRecord(name, 'C', traceNow(), value);
+}
+
+TraceScope::TraceScope(const char* name) {
+	name_ = name;
+	start_ = traceEnabled() ? traceNow() : -1;
+}
+
+TraceScope::~TraceScope() {
+	if (start_ >= 0 && traceEnabled())
+		traceRecord(name_, 'X', start_, traceNow() - start_);
+}
+
+void writeChromeTrace(const char* fname) {
+
+	std::ofstream out(fname);
+	out << "{\"traceEvents\": [\n";
+	bool first = true;
+	std::lock_guard<std::mutex> lock(traceThreadsMutex);
+	for (auto& thread : traceThreads) {
+		std::lock_guard<std::mutex> threadLock(thread->mutex);
+		out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread->id
+			<< ", \"args\": {\"name\": \"" << thread->name << "\"}}";
+		first = false;
+		// times are in microseconds
+		for (const TraceEvent& event : thread->events) {
+			out << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"" << event.phase << "\", \"pid\": 1, \"tid\": " << thread->id
+				<< ", \"ts\": " << event.start / 1000.0;
+			if (event.phase == 'X')
+				out << ", \"dur\": " << event.value / 1000.0 << "}";
+			else
+				out << ", \"args\": {\"value\": " << event.value << "}}";
+		}
+	}
+	out << "\n]}\n";
+}
+
+void writeTraceSummary(std::ostream& out) {
+
+	struct Total {
+		char phase;
+		int64_t calls = 0;
+		int64_t sum = 0;
+		int64_t largest = 0;
+	};
+	std::map <std::string, Total> totals;
+	{
+		std::lock_guard<std::mutex> lock(traceThreadsMutex);
+		for (auto& thread : traceThreads) {
+			std::lock_guard<std::mutex> threadLock(thread->mutex);
+			for (const TraceEvent& event : thread->events) {
+				Total& total = totals[event.name];
+				total.phase = event.phase;
+				++total.calls;
+				total.sum += event.value;
+				total.largest = std::max(total.largest, event.value);
+			}
+		}
+	}
+
+	for (const auto& entry : totals) {
+		const Total& total = entry.second;
+		if (total.phase == 'X')
+			out << entry.first << ": " << total.calls << " calls, " << total.sum / 1e6 << " ms total, " << total.sum / 1e6 / total.calls
+				<< " ms mean, " << total.largest / 1e6 << " ms max" << std::endl;
+		else
+			out << entry.first << ": " << total.calls << " samples, sum " << total.sum << ", max " << total.largest << std::endl;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// Instrumentation of the pipeline: scoped timers and counters recorded per thread and exported as a
+// Chrome trace (chrome://tracing, Perfetto) or summed up per name. The macros compile to nothing unless
+// HT_TRACE is defined, so normal builds carry no cost; with HT_TRACE they record only between traceStart
+// and traceStop, at a relaxed atomic load when stopped and an uncontended lock per event when recording.
+//
+//   TRACE_SCOPE("name");               duration of the enclosing block
+//   TRACE_COUNTER("name", value);      value at this point, value is not evaluated without HT_TRACE
+//   TRACE_THREAD_NAME(text);           label of the calling thread in the trace
+//
+// Names must be string literals or otherwise outlive the trace.
+
+void traceStart();
+
+void traceStop();
+
+bool traceEnabled();
+
+// Drops every recorded event
+void traceClear();
+
+void traceThreadName(const std::string& name);
+
+void traceCounter(const char* name, int64_t value);
+
+// Writes {"traceEvents": [...]} with a complete event per scope and a counter event per counter.
+// Call it while no traced code runs.
+void writeChromeTrace(const char* fname);
+
+// Per name: calls, total, mean and largest time of the scopes, or the sum and largest value of the counters
+void writeTraceSummary(std::ostream& out);
+
+struct TraceScope {
+
+	TraceScope(const char* name);
+
+	~TraceScope();
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char* name_;
+	int64_t start_;
+};
+
+#define TRACE_JOIN_NAME(left, right) left##right
+#define TRACE_UNIQUE_NAME(left, right) TRACE_JOIN_NAME(left, right)
+
+#ifdef HT_TRACE
+#define TRACE_SCOPE(name) TraceScope TRACE_UNIQUE_NAME(traceScope, __LINE__)(name)
+#define TRACE_COUNTER(name, value) traceCounter(name, (int64_t)(value))
+#define TRACE_THREAD_NAME(text) traceThreadName(text)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)sizeof(value))
+#define TRACE_THREAD_NAME(text) ((void)0)
+#endif
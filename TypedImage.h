@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+// Every row of an Image starts on a multiple of this many bytes
+const int ROW_ALIGNMENT = 64;
+
+inline void* alignedAllocate(size_t bytes) {
+	if (bytes == 0)
+		return nullptr;
+#ifdef _MSC_VER
+	void* memory = _aligned_malloc(bytes, ROW_ALIGNMENT);
+#else
+	void* memory = nullptr;
+	if (posix_memalign(&memory, ROW_ALIGNMENT, bytes) != 0)
+		memory = nullptr;
+#endif
+	if (memory == nullptr)
+		throw std::bad_alloc();
+	return memory;
+}
+
+inline void alignedFree(void* memory) {
+#ifdef _MSC_VER
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
+
+// Non-owning window onto pixels of type T. Rows are stride elements apart, so a view can
+// describe a whole image, a band of rows or a rectangle inside another image.
+template <typename T>
+struct ImageView {
+
+	ImageView() { data_ = nullptr; width_ = 0; height_ = 0; stride_ = 0; }
+
+	ImageView(T* data, int width, int height, ptrdiff_t stride) {
+		data_ = data; width_ = width; height_ = height; stride_ = stride;
+	}
+
+	int getWidth() const { return width_; }
+	int getHeight() const { return height_; }
+	ptrdiff_t getStride() const { return stride_; }
+
+	bool isEmpty() const { return width_ <= 0 || height_ <= 0; }
+
+	T* row(int y) const { return data_ + y * stride_; }
+
+	T& at(int x, int y) const { return data_[y * stride_ + x]; }
+
+	ImageView<T> crop(int x, int y, int width, int height) const {
+		return ImageView<T>(data_ + y * stride_ + x, width, height, stride_);
+	}
+
+	void fill(T value) const {
+		for (int y = 0; y < height_; ++y) {
+			T* line = row(y);
+			for (int x = 0; x < width_; ++x)
+				line[x] = value;
+		}
+	}
+
+	void copy(ImageView<T> source) const {
+		for (int y = 0; y < height_; ++y) {
+			T* line = row(y);
+			T* from = source.row(y);
+			for (int x = 0; x < width_; ++x)
+				line[x] = from[x];
+		}
+	}
+
+private:
+	T* data_;
+	int width_;
+	int height_;
+	ptrdiff_t stride_;
+};
+
+// Contiguous image owning its pixels. Rows are padded to ROW_ALIGNMENT bytes and the buffer is only
+// reallocated when a resize needs more memory than it already holds.
+template <typename T>
+struct Image {
+
+	Image(int width = 0, int height = 0, T value = T()) {
+		data_ = nullptr; width_ = 0; height_ = 0; stride_ = 0; capacity_ = 0;
+		resize(width, height);
+		fill(value);
+	}
+
+	~Image() { alignedFree(data_); }
+
+	Image(const Image&) = delete;
+	Image& operator=(const Image&) = delete;
+
+	int getWidth() { return this->width_; }
+	int getHeight() { return this->height_; }
+	ptrdiff_t getStride() { return this->stride_; }
+
+	T* row(int y) { return data_ + y * stride_; }
+
+	T& at(int x, int y) { return data_[y * stride_ + x]; }
+
+	ImageView<T> view() { return ImageView<T>(data_, width_, height_, stride_); }
+
+	operator ImageView<T>() { return view(); }
+
+	// Contents are not preserved
+	void resize(int width, int height) {
+		ptrdiff_t stride = alignedStride(width);
+		size_t size = (size_t)stride * (height > 0 ? height : 0);
+		if (size > capacity_) {
+			alignedFree(data_);
+			data_ = static_cast<T*>(alignedAllocate(size * sizeof(T)));
+			capacity_ = size;
+		}
+		width_ = width; height_ = height; stride_ = stride;
+	}
+
+	void fill(T value) { view().fill(value); }
+
+	void copy(ImageView<T> image) {
+		resize(image.getWidth(), image.getHeight());
+		view().copy(image);
+	}
+
+	// Number of elements a row occupies so that the next row starts aligned
+	static ptrdiff_t alignedStride(int width) {
+		size_t bytes = (size_t)(width > 0 ? width : 0) * sizeof(T);
+		size_t padded = (bytes + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT;
+		while (padded % sizeof(T) != 0)
+			padded += ROW_ALIGNMENT;
+		return (ptrdiff_t)(padded / sizeof(T));
+	}
+
+private:
+	T* data_;
+	int width_;
+	int height_;
+	ptrdiff_t stride_;
+	size_t capacity_;
+};